@@ -0,0 +1,97 @@
+#include "AsyncWriter.h"
+#include "Tracer.h"
+
+#include <stdexcept>
+#include <functional>
+
+AsyncWriter::AsyncWriter(const std::vector<std::shared_ptr<Observer>>& writers, std::size_t capacity, 
+  Backpressure policy) : queue(capacity, writers.size() > 1, policy) {
+  if (writers.empty()) {
+    throw std::runtime_error("writers do not exist");
+  }
+  for(auto& writer : writers) {
+    workers.emplace_back(new Worker{writer, {}});
+  }
+  static std::atomic<std::size_t> instances{0};
+  auto name = "async" + std::to_string(instances++);
+  gauge = Metrics::instance().addGauge(name, [this] { return queue.size(); });
+  for(auto& worker : workers) {
+    threads.emplace_back(&AsyncWriter::run, this, std::ref(*worker), name + "_" + std::to_string(threads.size()));
+  }
+}
+
+AsyncWriter::~AsyncWriter() {
+  queue.close();
+  for(auto& thread : threads) {
+    thread.join();
+  }
+  Metrics::instance().removeGauge(gauge);
+}
+
+void AsyncWriter::run(Worker& worker, const std::string& name) {
+  Metrics::setThreadName(name);
+  BulkPtr bulk;
+  while (queue.pop(bulk)) {
+    auto tracing = Tracer::enabled();
+    auto begin = tracing ? Tracer::Clock::now() : Tracer::Clock::time_point();
+    try {
+      std::lock_guard<std::mutex> lock(worker.mutex);
+      worker.writer->print(bulk);
+    } catch(...) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!error) 
+        error = std::current_exception();
+    }
+    if (tracing) {
+      Tracer::instance().complete("queued", bulk->id, bulk->commands.size(), bulk->closed, begin);
+      Tracer::instance().complete("write", bulk->id, bulk->commands.size(), begin, Tracer::Clock::now());
+    }
+    bulk.reset();
+    processed.fetch_add(1);
+    if (waiting.load() > 0) {
+      std::lock_guard<std::mutex> lock(mutex);
+      drained.notify_all();
+    }
+  }
+}
+
+void AsyncWriter::print(const BulkPtr& bulk) {
+  if (!bulk) {
+    throw std::runtime_error("commands do not exist");
+  }
+  pushed.fetch_add(1);
+  queue.push(bulk);
+}
+
+void AsyncWriter::printBatch(const std::vector<BulkPtr>& bulks) {
+  pushed.fetch_add(bulks.size());
+  for (auto& bulk : bulks) 
+    queue.push(bulk);
+}
+
+void AsyncWriter::flush() {
+  std::exception_ptr e;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    waiting.fetch_add(1);
+    drained.wait(lock, [this] { return processed.load() + queue.dropped() >= pushed.load(); });
+    waiting.fetch_sub(1);
+    std::swap(e, error);
+  }
+  for(auto& worker : workers) {
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    worker->writer->flush();
+  }
+  if (e) 
+    std::rethrow_exception(e);
+}
+
+std::size_t AsyncWriter::backlog() const {
+  return queue.size();
+}
+
+//-----------------------------------------------------------------------------------------------
+
+std::size_t AsyncWriter::dropped() const {
+  return queue.dropped();
+}
@@ -0,0 +1,43 @@
+#ifndef async_writer_h
+#define async_writer_h
+
+#include <thread>
+#include <exception>
+
+#include "Observer.h"
+#include "RingQueue.h"
+#include "Metrics.h"
+
+// Hands completed bulks over to worker threads, one thread per wrapped writer.
+// All workers share one bounded lock-free queue, so a bulk is printed by exactly one of them.
+// flush() may come from any thread, each writer is only touched under its own mutex.
+class AsyncWriter : public Observer {
+  struct Worker {
+    std::shared_ptr<Observer> writer;
+    std::mutex mutex;
+  };
+
+  RingQueue<BulkPtr> queue;
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<std::thread> threads;
+  std::atomic<std::size_t> pushed{0};
+  std::atomic<std::size_t> processed{0};
+  std::atomic<int> waiting{0};
+  std::mutex mutex;
+  std::condition_variable drained;
+  std::exception_ptr error;
+  Metrics::Gauge gauge;
+
+  void run(Worker& worker, const std::string& name);
+public:
+  AsyncWriter(const std::vector<std::shared_ptr<Observer>>& writers, std::size_t capacity = 1024, 
+    Backpressure policy = Backpressure::Block);
+  ~AsyncWriter();
+  void print(const BulkPtr& bulk) override;
+  void printBatch(const std::vector<BulkPtr>& bulks) override;
+  void flush() override;
+  std::size_t backlog() const override;
+  std::size_t dropped() const;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef basic_handler_h
+#define basic_handler_h
+
+#include <tuple>
+#include <memory>
+#include <vector>
+#include <type_traits>
+
+#include "BulkBuilder.h"
+#include "Metrics.h"
+
+// Handler with the writer set fixed at compile time: writers are owned directly
+// and print()/flush() are called by their static type, without weak_ptr locking or
+// virtual dispatch. Bulks come from the same BulkBuilder as in Handler; max delay,
+// adaptive size, batched printing and reports stay with Handler, which also keeps
+// runtime subscription for plugins.
+template<typename... Writers>
+class BasicHandler {
+  std::tuple<std::shared_ptr<Writers>...> writers;
+  BulkBuilder builder;
+
+  template<typename Writer>
+  static void print(Writer& writer, const BulkPtr& bulk) {
+    writer.Writer::print(bulk);
+  }
+
+  template<typename Writer>
+  static void flush(Writer& writer) {
+    writer.Writer::flush();
+  }
+
+  void print() {
+    auto published = builder.close();
+    std::apply([&](auto&... writer) { (print(*writer, published), ...); }, writers);
+  }
+
+  void add(std::string_view command, LineKind kind, ThreadMetrics& metrics) {
+    auto event = builder.add(command, kind, metrics);
+    if (event == BulkBuilder::Full || event == BulkBuilder::Closed)
+      print();
+  }
+
+public:
+  BasicHandler(const int& n, std::shared_ptr<Writers>... writers_) : writers(std::move(writers_)...), builder(n) {}
+
+  void addCommand(std::string_view command) {
+    add(command, classify_line(command), Metrics::local());
+  }
+
+  // as Handler::addCommands(), without the batching
+  void addCommands(const std::string_view* lines, const LineKind* kinds, std::size_t count) {
+    auto& metrics = Metrics::local();
+    for (std::size_t i = 0; i < count; i++)
+      add(lines[i], kinds ? kinds[i] : classify_line(lines[i]), metrics);
+  }
+  void addCommands(const std::vector<std::string_view>& lines) { addCommands(lines.data(), nullptr, lines.size()); }
+
+  void stop() {
+    if (builder.pending())
+      print();
+    builder.drop();
+    std::apply([](auto&... writer) { (flush(*writer), ...); }, writers);
+  }
+
+  // see BulkBuilder::setBlockMemory()
+  void setBlockMemory(std::size_t bytes) { builder.setBlockMemory(bytes); }
+  bool inBlock() const { return builder.inBlock(); }
+
+  template<std::size_t I>
+  auto& writer() const { return *std::get<I>(writers); }
+};
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef bulk_h
+#define bulk_h
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <ctime>
+#include <chrono>
+#include <initializer_list>
+
+#include "Spill.h"
+
+// Commands of one bulk stored back to back in a single buffer.
+// clear() keeps the capacity, so a recycled bulk takes new commands without allocating.
+class Commands {
+  std::string buffer;
+  std::vector<std::size_t> ends;
+public:
+  class const_iterator {
+    const Commands* commands;
+    std::size_t index;
+  public:
+    const_iterator(const Commands* commands_, std::size_t index_) : commands(commands_), index(index_) {}
+    std::string_view operator*() const { return (*commands)[index]; }
+    const_iterator& operator++() { index++; return *this; }
+    const_iterator operator++(int) { auto it = *this; index++; return it; }
+    bool operator==(const const_iterator& other) const { return index == other.index; }
+    bool operator!=(const const_iterator& other) const { return index != other.index; }
+    bool operator<(const const_iterator& other) const { return index < other.index; }
+  };
+
+  Commands() = default;
+  Commands(std::initializer_list<std::string_view> commands) {
+    for (auto command : commands) 
+      push_back(command);
+  }
+
+  void push_back(std::string_view command) {
+    buffer.append(command.data(), command.size());
+    ends.push_back(buffer.size());
+  }
+
+  void clear() {
+    buffer.clear();
+    ends.clear();
+  }
+
+  std::size_t size() const { return ends.size(); }
+  bool empty() const { return ends.empty(); }
+  std::size_t bytes() const { return buffer.size(); }
+
+  std::string_view operator[](std::size_t i) const {
+    auto begin = i ? ends[i - 1] : 0;
+    return std::string_view(buffer.data() + begin, ends[i] - begin);
+  }
+
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, size()); }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator cend() const { return end(); }
+
+  bool operator==(const Commands& other) const { 
+    return ends == other.ends && buffer == other.buffer; 
+  }
+};
+
+// A completed bulk. Handler publishes it once and never touches it again,
+// so writers may keep the pointer and print it whenever they like.
+struct Bulk {
+  Commands commands;
+  std::time_t time = 0;
+  std::size_t id = 0;
+  // "bulk: a, b\n", rendered once when the bulk closes and shared by every writer
+  std::string text;
+  // a dynamic block over BulkBuilder::setBlockMemory() is rendered into spill instead of text,
+  // its first spilled commands only live there, commands keeps the ones after them
+  std::shared_ptr<Spill> spill;
+  std::size_t spilled = 0;
+  // only filled in while Tracer is enabled
+  std::chrono::steady_clock::time_point arrived;
+  std::chrono::steady_clock::time_point closed;
+
+  void render() {
+    text.clear();
+    text += "bulk: ";
+    for (auto command = commands.cbegin(); command != commands.cend(); ++command) {
+      if (command != commands.cbegin()) 
+        text += ", ";
+      text += *command;
+    }
+    text += '\n';
+  }
+
+  // text or the mapped spill, whichever holds the rendered bulk
+  std::string_view output() const { return spill ? spill->view() : std::string_view(text); }
+
+  // the rendered line without its newline, as written to bulk files
+  std::string_view body() const { 
+    auto rendered = output();
+    return rendered.substr(0, rendered.empty() ? 0 : rendered.size() - 1); 
+  }
+};
+
+using BulkPtr = std::shared_ptr<const Bulk>;
+
+// Keeps published bulks and hands one out again once every writer has let it go,
+// so Handler reuses their buffers instead of allocating a new bulk each time.
+// Only the thread owning the Handler calls acquire().
+class BulkPool {
+  std::vector<std::shared_ptr<Bulk>> bulks;
+  std::size_t next = 0;
+  std::size_t limit;
+public:
+  BulkPool(std::size_t limit_ = 64) : limit(limit_) {}
+
+  std::shared_ptr<Bulk> acquire() {
+    for (std::size_t i = 0; i < bulks.size(); i++) {
+      auto& bulk = bulks[(next + i) % bulks.size()];
+      if (bulk.use_count() == 1) {
+        // pairs with the release done by the writer thread that dropped the last copy
+        std::atomic_thread_fence(std::memory_order_acquire);
+        next = (next + i + 1) % bulks.size();
+        bulk->commands.clear();
+        bulk->text.clear();
+        bulk->spill.reset();
+        bulk->spilled = 0;
+        bulk->time = 0;
+        bulk->id = 0;
+        return bulk;
+      }
+    }
+    if (bulks.size() < limit) {
+      bulks.push_back(std::make_shared<Bulk>());
+      return bulks.back();
+    }
+    return std::make_shared<Bulk>();
+  }
+};
+
+#endif
@@ -0,0 +1,112 @@
+#include "BulkBuilder.h"
+#include "Metrics.h"
+#include "Tracer.h"
+
+#include <stdexcept>
+
+BulkBuilder::BulkBuilder(int n) {
+  if (n <= 0) {
+    throw std::runtime_error("error set N");
+  }
+  N = size = n;
+  bulk = pool.acquire();
+}
+
+void BulkBuilder::resize(int n) {
+  size = n;
+  if (N != -1)
+    N = size;
+}
+
+BulkBuilder::Event BulkBuilder::add(std::string_view command, LineKind kind, ThreadMetrics& metrics) {
+  metrics.lines.add();
+  if (command.size() > max_size_commad) {
+    throw std::runtime_error("very large string");
+  }
+
+  if (N == 0) {
+    throw std::runtime_error("parameter is zero");
+  }
+
+  auto& commands = bulk->commands;
+  switch(parser.parsing(kind))
+  {
+    case BlockParser::Empty:
+      break;
+
+    case BlockParser::StartBlock:
+      N = -1;
+      if (commands.size() > 0)
+        return Closed;
+      break;
+
+    case BlockParser::CancelBlock:
+      N = size;
+      if (commands.empty() && !bulk->spilled) throw std::runtime_error("emty block");
+      return Closed;
+
+    case BlockParser::Command: {
+      // a spilled block has empty commands again, its first command stays the one that counts
+      bool opened = commands.empty() && !bulk->spilled;
+      if (opened) {
+        bulk->time = std::time(nullptr);
+        if (Tracer::enabled())
+          bulk->arrived = Tracer::Clock::now();
+      }
+      commands.push_back(command);
+      metrics.commands.add();
+      if (N == -1 && block_memory && commands.bytes() > block_memory)
+        spillBlock();
+      if (N != -1 && commands.size() == std::size_t(N))
+        return Full;
+      return opened ? Opened : Pending;
+    }
+
+    default: break;
+  }
+  return Pending;
+}
+
+// A block that never closes would grow without bound, so past block_memory its commands
+// go to the spill file already rendered and the same buffers take the next ones.
+void BulkBuilder::spillBlock() {
+  spill_text.clear();
+  if (!bulk->spill) {
+    bulk->spill = std::make_shared<Spill>();
+    spill_text = "bulk: ";
+  }
+  for (auto command : bulk->commands) {
+    if (bulk->spilled++)
+      spill_text += ", ";
+    spill_text += command;
+  }
+  bulk->spill->append(spill_text);
+  bulk->commands.clear();
+  Metrics::local().spilled.add(spill_text.size());
+}
+
+BulkPtr BulkBuilder::close() {
+  if (bulk->spill) {
+    spill_text.clear();
+    for (auto command : bulk->commands) {
+      spill_text += ", ";
+      spill_text += command;
+    }
+    spill_text += '\n';
+    bulk->spill->append(spill_text);
+    bulk->spill->finish();
+  } else {
+    bulk->render();
+  }
+  BulkPtr published = std::move(bulk);
+  bulk = pool.acquire();
+  bulk->id = published->id + 1;
+  Metrics::local().bulks.add();
+  return published;
+}
+
+void BulkBuilder::drop() {
+  bulk->commands.clear();
+  bulk->spill.reset();
+  bulk->spilled = 0;
+}
@@ -0,0 +1,60 @@
+#ifndef bulk_builder_h
+#define bulk_builder_h
+
+#include <string>
+#include <string_view>
+#include <memory>
+
+#include "Bulk.h"
+#include "Parser.h"
+
+struct ThreadMetrics;
+
+// The command to bulk state machine shared by Handler and BasicHandler: it parses
+// the lines, fills the current bulk and tells the caller when to close it. Closing
+// is left to the caller, which hands the bulk from close() to its writers.
+class BulkBuilder {
+  BulkPool pool;
+  std::shared_ptr<Bulk> bulk;
+  BlockParser parser;
+  int N = 0;
+  int size = 0;
+  std::size_t max_size_commad = 50;
+
+  // a dynamic block spills its commands to a file beyond block_memory bytes of them
+  std::size_t block_memory = 0;
+  std::string spill_text;
+
+  void spillBlock();
+public:
+  enum Event {
+    Pending,
+    // the first command of a static bulk or block arrived
+    Opened,
+    // a static bulk reached its size
+    Full,
+    // a block closed or a block start cut the static bulk short
+    Closed
+  };
+
+  BulkBuilder(int n);
+  // at most one bulk is to be closed per line, the caller does it before the next add();
+  // kind is classify_line() of the command, a batch may take it from classify_lines()
+  Event add(std::string_view command, LineKind kind, ThreadMetrics& metrics);
+  // renders the current bulk and starts the next one
+  BulkPtr close();
+  // drops an unclosed block, spilled part included
+  void drop();
+  // static bulk size, takes effect now unless a block is open
+  void resize(int n);
+  // past bytes of commands an open { } block moves them, already rendered, to a Spill file
+  // and reuses the buffers for the next ones; 0 keeps the whole block in memory
+  void setBlockMemory(std::size_t bytes) { block_memory = bytes; }
+  // a static bulk with commands waits to be closed
+  bool pending() const { return N != -1 && !bulk->commands.empty(); }
+  bool inBlock() const { return parser.depth() > 0; }
+  Bulk& current() { return *bulk; }
+  const Bulk& current() const { return *bulk; }
+};
+
+#endif
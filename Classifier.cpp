@@ -0,0 +1,62 @@
+#include "Classifier.h"
+
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+std::size_t classify_lines_scalar(const char* data, std::size_t size, std::vector<std::string_view>& lines,
+  std::vector<LineKind>& kinds, std::size_t max) {
+  std::size_t begin = 0;
+  for (std::size_t count = 0; count < max; count++) {
+    auto found = static_cast<const char*>(std::memchr(data + begin, '\n', size - begin));
+    if (!found) 
+      break;
+    std::string_view line(data + begin, found - (data + begin));
+    lines.push_back(line);
+    kinds.push_back(classify_line(line));
+    begin += line.size() + 1;
+  }
+  return begin;
+}
+
+//---------------------------------------------------------------------------------
+
+// Commands are a few bytes long, so a memchr call per line costs more than the scan itself.
+// Here one compare per 16 bytes yields the newline mask, the braces mask of the same bytes
+// tells the one byte lines that are delimiters without loading them again.
+std::size_t classify_lines(const char* data, std::size_t size, std::vector<std::string_view>& lines,
+  std::vector<LineKind>& kinds, std::size_t max) {
+#if defined(__SSE2__)
+  std::size_t begin = 0, count = 0, pos = 0;
+  if (max == 0) 
+    return 0;
+  const auto newline = _mm_set1_epi8('\n');
+  const auto open = _mm_set1_epi8('{');
+  const auto close = _mm_set1_epi8('}');
+  for (; pos + 16 <= size; pos += 16) {
+    auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+    unsigned newlines = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+    if (!newlines) 
+      continue;
+    unsigned braces = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, open), _mm_cmpeq_epi8(chunk, close)));
+    do {
+      unsigned bit = __builtin_ctz(newlines);
+      newlines &= newlines - 1;
+      auto end = pos + bit;
+      lines.emplace_back(data + begin, end - begin);
+      auto kind = LineKind::Text;
+      if (end - begin == 1 && (bit == 0 ? data[begin] == '{' || data[begin] == '}' : (braces >> (bit - 1)) & 1)) 
+        kind = data[begin] == '{' ? LineKind::Open : LineKind::Close;
+      kinds.push_back(kind);
+      begin = end + 1;
+      if (++count == max) 
+        return begin;
+    } while (newlines);
+  }
+  return begin + classify_lines_scalar(data + begin, size - begin, lines, kinds, max - count);
+#else
+  return classify_lines_scalar(data, size, lines, kinds, max);
+#endif
+}
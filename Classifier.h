@@ -0,0 +1,30 @@
+#ifndef classifier_h
+#define classifier_h
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// What a line is for BlockParser, decided once while the input is split.
+enum class LineKind : std::uint8_t {
+  Text,
+  Open,  // exactly "{"
+  Close  // exactly "}"
+};
+
+inline LineKind classify_line(std::string_view line) {
+  if (line.size() != 1) 
+    return LineKind::Text;
+  return line[0] == '{' ? LineKind::Open : line[0] == '}' ? LineKind::Close : LineKind::Text;
+}
+
+// Appends the views and kinds of the complete lines of data, at most max of them.
+// Returns the bytes taken, which end after the last newline found.
+// classify_lines() scans 16 bytes at a time with SSE2 where the target has it,
+// classify_lines_scalar() is the memchr loop it replaces.
+std::size_t classify_lines(const char* data, std::size_t size, std::vector<std::string_view>& lines,
+  std::vector<LineKind>& kinds, std::size_t max = std::size_t(-1));
+std::size_t classify_lines_scalar(const char* data, std::size_t size, std::vector<std::string_view>& lines,
+  std::vector<LineKind>& kinds, std::size_t max = std::size_t(-1));
+
+#endif
@@ -0,0 +1,132 @@
+#include "Compressor.h"
+
+#include <stdexcept>
+
+#ifdef BULK_ZLIB
+#include <zlib.h>
+#endif
+
+struct Compressor::State {
+#ifdef BULK_ZLIB
+  z_stream deflate;
+  bool deflating = false;
+#endif
+  int level = 0;
+};
+
+bool Compressor::available(Codec codec) {
+  switch(codec)
+  {
+#ifdef BULK_ZLIB
+    case Gzip: return true;
+#endif
+    case None: return true;
+    default: return false;
+  }
+}
+
+const char* Compressor::extension(Codec codec) {
+  switch(codec)
+  {
+    case Gzip: return ".gz";
+    default: return "";
+  }
+}
+
+Compressor::Codec Compressor::parse(const std::string& name) {
+  if (name == "none")
+    return None;
+  if (name == "gzip")
+    return Gzip;
+  throw std::runtime_error("Incorrect compression " + name);
+}
+
+//-----------------------------------------------------------------------------------------------
+
+Compressor::Compressor(Codec codec_, int level) : codec(codec_), state(new State) {
+  if (!available(codec)) {
+    throw std::runtime_error("gzip is not built in");
+  }
+  state->level = level;
+#ifdef BULK_ZLIB
+  if (codec == Gzip) {
+    state->deflate = z_stream();
+    // 16 + window bits asks for a gzip header instead of a raw zlib one
+    if (deflateInit2(&state->deflate, level ? level : Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + 15, 8,
+        Z_DEFAULT_STRATEGY) != Z_OK) {
+      throw std::runtime_error("deflateInit2 failed");
+    }
+    state->deflating = true;
+  }
+#endif
+}
+
+Compressor::~Compressor() {
+#ifdef BULK_ZLIB
+  if (state->deflating)
+    deflateEnd(&state->deflate);
+#endif
+}
+
+void Compressor::compress(std::string_view in, std::string& out) {
+  auto begin = out.size();
+  switch(codec)
+  {
+#ifdef BULK_ZLIB
+    case Gzip: {
+      auto& stream = state->deflate;
+      deflateReset(&stream);
+      out.resize(begin + deflateBound(&stream, in.size()));
+      stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+      stream.avail_in = in.size();
+      stream.next_out = reinterpret_cast<Bytef*>(&out[begin]);
+      stream.avail_out = out.size() - begin;
+      if (deflate(&stream, Z_FINISH) != Z_STREAM_END)
+        throw std::runtime_error("deflate failed");
+      out.resize(out.size() - stream.avail_out);
+      break;
+    }
+#endif
+    default:
+      out.append(in.data(), in.size());
+      break;
+  }
+}
+
+void Compressor::decompress(std::string_view in, std::string& out) {
+  auto bytes = reinterpret_cast<const unsigned char*>(in.data());
+  if (in.size() >= 2 && bytes[0] == 0x1f && bytes[1] == 0x8b) {
+#ifdef BULK_ZLIB
+    char chunk[1 << 16];
+    z_stream stream = z_stream();
+    // 32 + window bits detects gzip headers
+    if (inflateInit2(&stream, 32 + 15) != Z_OK)
+      throw std::runtime_error("inflateInit2 failed");
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    stream.avail_in = in.size();
+    for (;;) {
+      stream.next_out = reinterpret_cast<Bytef*>(chunk);
+      stream.avail_out = sizeof(chunk);
+      auto result = inflate(&stream, Z_NO_FLUSH);
+      if (result != Z_OK && result != Z_STREAM_END) {
+        inflateEnd(&stream);
+        throw std::runtime_error("corrupt gzip frame");
+      }
+      out.append(chunk, sizeof(chunk) - stream.avail_out);
+      if (result == Z_STREAM_END) {
+        if (stream.avail_in == 0)
+          break;
+        inflateReset(&stream);
+      } else if (stream.avail_in == 0 && stream.avail_out != 0) {
+        inflateEnd(&stream);
+        throw std::runtime_error("truncated gzip frame");
+      }
+    }
+    inflateEnd(&stream);
+    return;
+#else
+    throw std::runtime_error("gzip is not built in");
+#endif
+  }
+  out.append(in.data(), in.size());
+}
@@ -0,0 +1,42 @@
+#ifndef compressor_h
+#define compressor_h
+
+#include <string>
+#include <string_view>
+#include <memory>
+
+// Compressed frames for bulk files, gzip through zlib when it was found at build time.
+// Every compress() call makes one complete frame. Frames may be concatenated and
+// decompress() reads them all back, so appending to a compressed file keeps it readable.
+class Compressor {
+public:
+  enum Codec {
+    None,
+    Gzip
+  };
+
+  static bool available(Codec codec);
+  // file name suffix of the codec, empty for None
+  static const char* extension(Codec codec);
+  // "none" or "gzip"
+  static Codec parse(const std::string& name);
+
+  // throws std::runtime_error when the codec was not built in
+  explicit Compressor(Codec codec_, int level = 0);
+  Compressor(const Compressor&) = delete;
+  Compressor& operator=(const Compressor&) = delete;
+  ~Compressor();
+
+  Codec getCodec() const { return codec; }
+  // appends one frame holding in to out
+  void compress(std::string_view in, std::string& out);
+  // appends the content of all frames in in to out, the codec is told by the frame magic
+  static void decompress(std::string_view in, std::string& out);
+
+private:
+  struct State;
+  Codec codec;
+  std::unique_ptr<State> state;
+};
+
+#endif
@@ -0,0 +1,154 @@
+#include "Dispatcher.h"
+#include "Writers.h"
+#include "AsyncWriter.h"
+#include "Observer.h"
+
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+Dispatcher::Dispatcher(const std::vector<std::shared_ptr<Observer>>& writers_) : writers(writers_) {}
+
+Dispatcher::~Dispatcher() {
+  std::vector<handle_t> handles;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for(auto& context : contexts) {
+      handles.push_back(context.first);
+    }
+  }
+  for(auto handle : handles) {
+    try {
+      disconnect(handle);
+    } catch(...) {}
+  }
+  try {
+    flush();
+  } catch(...) {}
+}
+
+void Dispatcher::flush() {
+  for(auto& writer : writers) {
+    writer->flush();
+  }
+}
+
+std::shared_ptr<Dispatcher::Context> Dispatcher::find(handle_t handle) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto context = contexts.find(handle);
+  if (context == contexts.end()) {
+    throw std::runtime_error("unknown handle");
+  }
+  return context->second;
+}
+
+Dispatcher::handle_t Dispatcher::connect(std::size_t bulk) {
+  auto context = std::make_shared<Context>();
+  context->handler = std::make_shared<Handler>(bulk);
+  context->handler->setBlockMemory(block_memory);
+  for(auto& writer : writers) {
+    context->handler->subscribe(writer);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto& common = shared[bulk];
+  if (!common) {
+    common = std::make_shared<Shared>();
+    common->handler = std::make_shared<Handler>(bulk);
+    for(auto& writer : writers) {
+      common->handler->subscribe(writer);
+    }
+  }
+  common->contexts++;
+  context->shared = common;
+  handle_t handle = context.get();
+  contexts[handle] = context;
+  return handle;
+}
+
+void Dispatcher::addCommand(Context& context, std::string_view command) {
+  if (!context.handler->inBlock() && command != "{") {
+    std::lock_guard<std::mutex> lock(context.shared->mutex);
+    context.shared->handler->addCommand(command);
+  } else {
+    context.handler->addCommand(command);
+  }
+}
+
+void Dispatcher::receive(handle_t handle, const char* data, std::size_t size) {
+  auto context = find(handle);
+  std::lock_guard<std::mutex> lock(context->mutex);
+  auto end = data + size;
+  while (data < end) {
+    auto found = static_cast<const char*>(std::memchr(data, '\n', end - data));
+    if (!found) {
+      context->partial.append(data, end - data);
+      break;
+    }
+    if (context->partial.empty()) {
+      addCommand(*context, std::string_view(data, found - data));
+    } else {
+      context->partial.append(data, found - data);
+      // taken out first, so a line that throws does not stay glued to the next data
+      std::string line;
+      line.swap(context->partial);
+      addCommand(*context, line);
+    }
+    data = found + 1;
+  }
+}
+
+void Dispatcher::disconnect(handle_t handle) {
+  auto context = find(handle);
+  {
+    std::lock_guard<std::mutex> lock(context->mutex);
+    if (!context->partial.empty()) {
+      std::string line;
+      line.swap(context->partial);
+      addCommand(*context, line);
+    }
+    context->handler->finish();
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  contexts.erase(handle);
+  auto& common = context->shared;
+  std::lock_guard<std::mutex> shared_lock(common->mutex);
+  if (--common->contexts == 0) {
+    common->handler->finish();
+    for(auto it = shared.begin(); it != shared.end(); it++) {
+      if (it->second == common) {
+        shared.erase(it);
+        break;
+      }
+    }
+  }
+}
+
+//---------------------------------------------------------------------------------
+
+namespace async {
+
+  static Dispatcher& dispatcher() {
+    static auto console = std::make_shared<AsyncWriter>(
+      std::vector<std::shared_ptr<Observer>>{std::make_shared<ConsoleWriter>()});
+    static auto files = std::make_shared<AsyncWriter>(
+      std::vector<std::shared_ptr<Observer>>{std::make_shared<FileWriter>(), std::make_shared<FileWriter>()});
+    static Dispatcher instance({console, files});
+    return instance;
+  }
+
+  handle_t connect(std::size_t bulk) {
+    return dispatcher().connect(bulk);
+  }
+
+  void receive(handle_t handle, const char* data, std::size_t size) {
+    dispatcher().receive(handle, data, size);
+  }
+
+  // a disconnected stream is written before this returns, as callers of the library expect
+  void disconnect(handle_t handle) {
+    dispatcher().disconnect(handle);
+    dispatcher().flush();
+  }
+}
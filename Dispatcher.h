@@ -0,0 +1,65 @@
+#ifndef dispatcher_h
+#define dispatcher_h
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Handler.h"
+
+class Observer;
+
+// Runs many independent command streams in one process on a shared set of writers.
+// Commands outside of { } blocks are merged across all streams with the same bulk size,
+// dynamic blocks stay with the stream that opened them.
+class Dispatcher {
+public:
+  using handle_t = void*;
+private:
+  struct Shared {
+    std::mutex mutex;
+    std::shared_ptr<Handler> handler;
+    std::size_t contexts = 0;
+  };
+
+  struct Context {
+    std::mutex mutex;
+    std::shared_ptr<Handler> handler;
+    std::shared_ptr<Shared> shared;
+    std::string partial;
+  };
+
+  std::vector<std::shared_ptr<Observer>> writers;
+  std::size_t block_memory = 0;
+  std::mutex mutex;
+  std::map<std::size_t, std::shared_ptr<Shared>> shared;
+  std::map<handle_t, std::shared_ptr<Context>> contexts;
+
+  std::shared_ptr<Context> find(handle_t handle);
+  void addCommand(Context& context, std::string_view command);
+public:
+  Dispatcher(const std::vector<std::shared_ptr<Observer>>& writers_);
+  ~Dispatcher();
+  // memory cap of the dynamic blocks of streams connected afterwards, see Handler::setBlockMemory()
+  void setBlockMemory(std::size_t bytes) { block_memory = bytes; }
+  handle_t connect(std::size_t bulk);
+  void receive(handle_t handle, const char* data, std::size_t size);
+  // the stream's bulks are printed, not written, writing is up to flush()
+  void disconnect(handle_t handle);
+  // waits until the writers have written everything printed so far
+  void flush();
+};
+
+// The same API on a process-wide Dispatcher printing to the console and
+// to bulk files from background threads.
+namespace async {
+  using handle_t = Dispatcher::handle_t;
+
+  handle_t connect(std::size_t bulk);
+  void receive(handle_t handle, const char* data, std::size_t size);
+  void disconnect(handle_t handle);
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef durability_h
+#define durability_h
+
+#include "FlushPolicy.h"
+
+// How much of its output a file writer forces to stable storage.
+// Group commits every group.bulks bulks or group.interval, one sync covering all of them,
+// and whatever is left when the writer is flushed at stop.
+struct Durability {
+  enum Mode {
+    None,
+    Group,
+    PerBulk
+  };
+
+  Mode mode = None;
+  FlushPolicy group;
+};
+
+// "none", "bulk", "group:<bulks>" or "group:<milliseconds>ms"
+Durability parse_durability(const std::string& value);
+
+#endif
@@ -0,0 +1,210 @@
+#include "FileWriterPool.h"
+#include "Metrics.h"
+#include "Tracer.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+FileWriterPool::FileWriterPool(std::size_t size, const FlushPolicy& policy, std::size_t capacity_, Backpressure backpressure_,
+  FileWriter::Backend backend, const Durability& durability, Compressor::Codec codec) 
+  : capacity(capacity_ ? capacity_ : 1), backpressure(backpressure_) {
+  if (size == 0) {
+    throw std::runtime_error("writers do not exist");
+  }
+  for (std::size_t i = 0; i < size; i++) {
+    workers.emplace_back(new Worker);
+    workers.back()->writer = std::make_shared<FileWriter>(policy, backend, durability, codec);
+  }
+  gauge = Metrics::instance().addGauge("file_pool", [this] { return queued.load(); });
+  for (std::size_t i = 0; i < size; i++) {
+    threads.emplace_back(&FileWriterPool::run, this, i);
+  }
+}
+
+FileWriterPool::~FileWriterPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopped = true;
+  }
+  work.notify_all();
+  room.notify_all();
+  for(auto& thread : threads) {
+    thread.join();
+  }
+  Metrics::instance().removeGauge(gauge);
+}
+
+bool FileWriterPool::take(std::size_t index, BulkPtr& bulk) {
+  {
+    auto& own = *workers[index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.bulks.empty()) {
+      bulk = std::move(own.bulks.front().bulk);
+      own.bulks.pop_front();
+      queued--;
+      return true;
+    }
+  }
+  for (std::size_t i = 1; i < workers.size(); i++) {
+    auto& victim = *workers[(index + i) % workers.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.bulks.empty()) {
+      bulk = std::move(victim.bulks.back().bulk);
+      victim.bulks.pop_back();
+      queued--;
+      workers[index]->stolen++;
+      return true;
+    }
+  }
+  return false;
+}
+
+void FileWriterPool::run(std::size_t index) {
+  Metrics::setThreadName("file" + std::to_string(index));
+  auto& worker = *workers[index];
+  BulkPtr bulk;
+  for (;;) {
+    if (!take(index, bulk)) {
+      std::unique_lock<std::mutex> lock(mutex);
+      if (queued.load() == 0 && stopped) 
+        return;
+      work.wait(lock, [this] { return stopped || queued.load() > 0; });
+      continue;
+    }
+    auto tracing = Tracer::enabled();
+    auto begin = tracing ? Tracer::Clock::now() : Tracer::Clock::time_point();
+    try {
+      std::lock_guard<std::mutex> lock(worker.writer_mutex);
+      auto before = worker.writer->getBytes();
+      worker.writer->print(bulk);
+      worker.bytes += worker.writer->getBytes() - before;
+    } catch(...) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!error) 
+        error = std::current_exception();
+    }
+    if (tracing) {
+      Tracer::instance().complete("queued", bulk->id, bulk->commands.size(), bulk->closed, begin);
+      Tracer::instance().complete("write", bulk->id, bulk->commands.size(), begin, Tracer::Clock::now());
+    }
+    worker.printed++;
+    worker.commands += bulk->commands.size();
+    bulk.reset();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    room.notify_one();
+    if (--pending == 0) 
+      drained.notify_all();
+  }
+}
+
+// Called with mutex held. Returns how many of count bulks to queue now, 0 once stopped.
+std::size_t FileWriterPool::reserve(std::unique_lock<std::mutex>& lock, std::size_t count) {
+  if (backpressure == Backpressure::Spill) 
+    return stopped ? 0 : count;
+  if (backpressure == Backpressure::DropOldest) {
+    count = std::min(count, capacity);
+    // bulks already taken by a worker cannot be dropped, then there is nothing to do but wait
+    while (pending + count > capacity && dropOldest()) {}
+  }
+  room.wait(lock, [this] { return stopped || pending < capacity; });
+  if (stopped) 
+    return 0;
+  return std::min(capacity - pending, count);
+}
+
+// Called with mutex held. Every deque is locked, so no worker takes the bulk meanwhile.
+bool FileWriterPool::dropOldest() {
+  std::vector<std::unique_lock<std::mutex>> locks;
+  Worker* victim = nullptr;
+  for(auto& worker : workers) {
+    locks.emplace_back(worker->mutex);
+    if (!worker->bulks.empty() && (!victim || worker->bulks.front().sequence < victim->bulks.front().sequence)) 
+      victim = worker.get();
+  }
+  if (!victim) 
+    return false;
+  victim->bulks.pop_front();
+  queued--;
+  pending--;
+  dropped_count++;
+  return true;
+}
+
+void FileWriterPool::print(const BulkPtr& bulk) {
+  if (!bulk) {
+    throw std::runtime_error("commands do not exist");
+  }
+  std::size_t stamp;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!reserve(lock, 1)) 
+      return;
+    pending++;
+    queued++;
+    stamp = sequence++;
+  }
+  {
+    auto& worker = *workers[next++ % workers.size()];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.bulks.push_back(Queued{stamp, bulk});
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  work.notify_one();
+}
+
+// Takes room for as many bulks as fit with one lock and wakes the workers once for them.
+void FileWriterPool::printBatch(const std::vector<BulkPtr>& bulks) {
+  std::size_t done = 0;
+  while (done < bulks.size()) {
+    std::size_t count = 0;
+    std::size_t stamp;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      count = reserve(lock, bulks.size() - done);
+      if (!count) 
+        return;
+      pending += count;
+      queued += count;
+      stamp = sequence;
+      sequence += count;
+    }
+    for (auto end = done + count; done < end; done++) {
+      auto& worker = *workers[next++ % workers.size()];
+      std::lock_guard<std::mutex> lock(worker.mutex);
+      worker.bulks.push_back(Queued{stamp++, bulks[done]});
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    work.notify_all();
+  }
+}
+
+void FileWriterPool::flush() {
+  std::exception_ptr e;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    drained.wait(lock, [this] { return pending == 0; });
+    std::swap(e, error);
+  }
+  for(auto& worker : workers) {
+    std::lock_guard<std::mutex> lock(worker->writer_mutex);
+    auto before = worker->writer->getBytes();
+    worker->writer->flush();
+    worker->bytes += worker->writer->getBytes() - before;
+  }
+  if (e) 
+    std::rethrow_exception(e);
+}
+
+std::vector<FileWriterPool::Stats> FileWriterPool::stats() const {
+  std::vector<Stats> result;
+  for(auto& worker : workers) {
+    Stats stats;
+    stats.bulks = worker->printed.load();
+    stats.commands = worker->commands.load();
+    stats.bytes = worker->bytes.load();
+    stats.stolen = worker->stolen.load();
+    result.push_back(stats);
+  }
+  return result;
+}
@@ -0,0 +1,80 @@
+#ifndef file_writer_pool_h
+#define file_writer_pool_h
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <exception>
+#include <condition_variable>
+
+#include "Writers.h"
+#include "Metrics.h"
+#include "RingQueue.h"
+
+// Persists bulks in parallel on a fixed set of FileWriter threads.
+// Bulks are dealt round-robin into per-worker deques, a worker that runs dry
+// steals from the back of the others, so one slow disk write does not hold up the rest.
+// Once capacity bulks are pending, Block waits for room, DropOldest discards the oldest
+// queued bulk of any worker and Spill lets the deques grow past capacity.
+class FileWriterPool : public Observer {
+public:
+  struct Stats {
+    std::size_t bulks = 0;
+    std::size_t commands = 0;
+    std::size_t bytes = 0;
+    std::size_t stolen = 0;
+  };
+private:
+  // sequence orders bulks across the deques, so DropOldest finds the oldest one
+  struct Queued {
+    std::size_t sequence;
+    BulkPtr bulk;
+  };
+
+  struct Worker {
+    std::shared_ptr<FileWriter> writer;
+    std::mutex mutex;
+    std::deque<Queued> bulks;
+    std::mutex writer_mutex;
+    std::atomic<std::size_t> printed{0};
+    std::atomic<std::size_t> commands{0};
+    std::atomic<std::size_t> bytes{0};
+    std::atomic<std::size_t> stolen{0};
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<std::thread> threads;
+  std::size_t capacity;
+  Backpressure backpressure;
+  std::size_t next = 0;
+  std::size_t sequence = 0;
+  std::atomic<std::size_t> dropped_count{0};
+  std::atomic<std::size_t> queued{0};
+  std::size_t pending = 0;
+  bool stopped = false;
+  std::mutex mutex;
+  std::condition_variable work;
+  std::condition_variable room;
+  std::condition_variable drained;
+  std::exception_ptr error;
+  Metrics::Gauge gauge;
+
+  bool take(std::size_t index, BulkPtr& bulk);
+  void run(std::size_t index);
+  std::size_t reserve(std::unique_lock<std::mutex>& lock, std::size_t count);
+  bool dropOldest();
+public:
+  FileWriterPool(std::size_t size, const FlushPolicy& policy = FlushPolicy(), std::size_t capacity_ = 1024,
+    Backpressure backpressure_ = Backpressure::Block, FileWriter::Backend backend = FileWriter::Backend::Blocking, const Durability& durability = Durability(),
+    Compressor::Codec codec = Compressor::None);
+  ~FileWriterPool();
+  void print(const BulkPtr& bulk) override;
+  void printBatch(const std::vector<BulkPtr>& bulks) override;
+  void flush() override;
+  std::size_t backlog() const override { return queued.load(); }
+  std::size_t dropped() const { return dropped_count.load(); }
+  std::vector<Stats> stats() const;
+};
+
+#endif
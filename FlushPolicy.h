@@ -0,0 +1,36 @@
+#ifndef flush_policy_h
+#define flush_policy_h
+
+#include <chrono>
+#include <string>
+
+// When a buffering writer hands its pending output to the system.
+// due() is checked as bulks arrive, an Interval is also checked by the writer's timer
+// while none do.
+struct FlushPolicy {
+  enum Mode {
+    PerBulk,
+    EveryBulks,
+    Interval,
+    OnStop
+  };
+
+  Mode mode = PerBulk;
+  std::size_t bulks = 1;
+  std::chrono::milliseconds interval{0};
+
+  bool due(std::size_t pending, std::chrono::steady_clock::time_point last_flush) const {
+    switch(mode)
+    {
+      case PerBulk: return true;
+      case EveryBulks: return pending >= bulks;
+      case Interval: return std::chrono::steady_clock::now() - last_flush >= interval;
+      default: return false;
+    }
+  }
+};
+
+// "bulk", "stop", "<K>" for every K bulks or "<T>ms"
+FlushPolicy parse_flush_policy(const std::string& value);
+
+#endif
@@ -1,28 +1,155 @@
 #include "Handler.h"
 #include "Observer.h"
+#include "Metrics.h"
+#include "Tracer.h"
 
 #include <algorithm>
+#include <stdexcept>
 
-Handler::Handler(const int& n) {
-  if (n <= 0) {
-    throw std::runtime_error("error set N"); 
-  } 
-  N = n;
-  commands = std::make_shared<Commands>();
+Handler::Handler(const int& n) : builder(n), size(n) {}
+
+Handler::~Handler() {
+  stopTimer();
+}
+
+void Handler::setAdaptive(int min, int max) {
+  if (min <= 0 || max < min) {
+    throw std::runtime_error("error set adaptive bulk size"); 
+  }
+  min_size = min;
+  max_size = max;
+  size = std::min(std::max(size, min_size), max_size);
+  builder.resize(size);
+  filled = std::chrono::steady_clock::now();
+}
+
+// A bulk filled within fast means the input outruns the writers per bulk cost,
+// a bulk that waited longer than slow with idle writers only adds latency.
+void Handler::printStatic() {
+  print();
+  if (!max_size) 
+    return;
+  static constexpr auto fast = std::chrono::milliseconds(1);
+  static constexpr auto slow = std::chrono::milliseconds(50);
+  auto now = std::chrono::steady_clock::now();
+  auto elapsed = now - filled;
+  filled = now;
+  sizes[size]++;
+
+  std::size_t backlog = 0;
+  for (auto& writer : writers) {
+    if (auto w = writer.lock()) 
+      backlog += w->backlog();
+  }
+  if (backlog > 1 || elapsed < fast) {
+    size = std::min(size * 2, max_size);
+  } else if (backlog == 0 && elapsed > slow) {
+    size = std::max(size / 2, min_size);
+  }
+  builder.resize(size);
+}
+
+void Handler::setMaxDelay(std::chrono::milliseconds delay) {
+  stopTimer();
+  if (delay.count() <= 0) 
+    return;
+  auto period = std::max(delay / 8, std::chrono::milliseconds(1));
+  max_delay_ticks = (delay.count() + period.count() - 1) / period.count();
+  timer_stopped = false;
+  timer = std::thread(&Handler::tick, this, period);
+}
+
+void Handler::stopTimer() {
+  if (!timer.joinable()) 
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    timer_stopped = true;
+  }
+  timer_wake.notify_all();
+  timer.join();
+  max_delay_ticks = 0;
+}
+
+void Handler::tick(std::chrono::milliseconds period) {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!timer_wake.wait_for(lock, period, [this] { return timer_stopped; })) {
+    auto now = ticks.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (builder.pending() && now - opened >= max_delay_ticks) {
+      try {
+        printStatic();
+      } catch(...) {
+        timer_error = std::current_exception();
+        return;
+      }
+    }
+  }
+}
+
+void Handler::rethrowTimerError() {
+  if (!timer_error) 
+    return;
+  auto error = timer_error;
+  timer_error = nullptr;
+  std::rethrow_exception(error);
 }
 
 void Handler::print() {
+  auto tracing = Tracer::enabled();
+  if (tracing) {
+    auto& bulk = builder.current();
+    bulk.closed = Tracer::Clock::now();
+    // the first command may have come before tracing started
+    auto arrived = bulk.arrived == Tracer::Clock::time_point() ? bulk.closed : bulk.arrived;
+    Tracer::instance().complete("collect", bulk.id, bulk.commands.size(), arrived, bulk.closed);
+  }
+  auto published = builder.close();
+  if (batching) {
+    closed.push_back(std::move(published));
+    // half of the pool, the writers release these while the rest of the batch is parsed
+    if (closed.size() == max_batch) {
+      dispatch();
+      batching = true;
+    }
+    return;
+  }
+  for(auto& writer : writers) {
+    if (!writer.expired()) {
+      auto begin = tracing ? Tracer::Clock::now() : Tracer::Clock::time_point();
+      writer.lock()->print(published);
+      if (tracing) 
+        Tracer::instance().complete("print", published->id, published->commands.size(), begin, Tracer::Clock::now());
+    }
+  }
+}
+
+void Handler::dispatch() {
+  batching = false;
+  if (closed.empty()) 
+    return;
+  // taken out first, so a throwing writer does not get the same bulks twice
+  std::vector<BulkPtr> bulks;
+  bulks.swap(closed);
+  auto tracing = Tracer::enabled();
   for(auto& writer : writers) {
     if (!writer.expired()) {
-      writer.lock()->print();
+      auto begin = tracing ? Tracer::Clock::now() : Tracer::Clock::time_point();
+      writer.lock()->printBatch(bulks);
+      if (tracing) {
+        auto end = Tracer::Clock::now();
+        for (auto& published : bulks) 
+          Tracer::instance().complete("print", published->id, published->commands.size(), begin, end);
+      }
     }
   }
+  bulks.clear();
+  closed.swap(bulks);
 }
 
-void Handler::update() {
+void Handler::flush() {
   for(auto& writer : writers) {
     if (!writer.expired()) {
-      writer.lock()->update(commands);
+      writer.lock()->flush();
     }
   }
 }
@@ -31,48 +158,69 @@ void Handler::subscribe(const std::weak_ptr<Observer>& obs) {
   writers.push_back(obs);
 }
 
-void Handler::addCommand(const std::string& command) { 
-  if (command.size() > max_size_commad) {
-    throw std::runtime_error("very large string");
+void Handler::addCommand(std::string_view command) { 
+  std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
+  if (max_delay_ticks) 
+    lock.lock();
+  rethrowTimerError();
+  add(command, classify_line(command), Metrics::local());
+}
+
+void Handler::addCommands(const std::string_view* lines, const LineKind* kinds, std::size_t count) { 
+  std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
+  if (max_delay_ticks) 
+    lock.lock();
+  rethrowTimerError();
+  auto& metrics = Metrics::local();
+  batching = true;
+  try {
+    for (std::size_t i = 0; i < count; i++) 
+      add(lines[i], kinds ? kinds[i] : classify_line(lines[i]), metrics);
+  } catch(...) {
+    // the bulks closed before the bad line are printed as addCommand() would have
+    dispatch();
+    throw;
   }
-  
-  if (N == 0) {
-    throw std::runtime_error("parameter is zero"); 
-  } 
+  dispatch();
+}
 
-  switch(parser.parsing(command))
+void Handler::add(std::string_view command, LineKind kind, ThreadMetrics& metrics) { 
+  switch(builder.add(command, kind, metrics))
   {
-    case BlockParser::Empty: 
-      break;
-
-    case BlockParser::StartBlock: 
-      N = -1; 
-      if (commands->size() > 0)
-        print();
-      commands->clear();
+    case BulkBuilder::Opened: 
+      opened = ticks.load(std::memory_order_relaxed);
       break;
 
-    case BlockParser::CancelBlock:
-      N = commands->size();
-      if (N == 0) throw std::runtime_error("emty block");
+    case BulkBuilder::Full: 
+      printStatic();
       break;
 
-    case BlockParser::Command:
-      commands->push_back(command);
-      update();
+    case BulkBuilder::Closed:
+      print();
       break;
 
     default: break;
   }
+}
 
-  if (commands->size() == N) {
+void Handler::finish() {
+  stopTimer();
+  rethrowTimerError();
+  if (builder.pending())
     print();
-    commands->clear();
-  }
+  builder.drop();
 }
 
 void Handler::stop() {
-  if (N != -1 && commands->size())
-    print();
-  commands->clear();
+  finish();
+  flush();
+  if (report) {
+    Metrics::instance().report(*report);
+    if (max_size) {
+      *report << "bulk sizes:";
+      for (auto& chosen_size : sizes) 
+        *report << " " << chosen_size.first << "x" << chosen_size.second;
+      *report << std::endl;
+    }
+  }
 }
@@ -4,27 +4,86 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <ostream>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <map>
+#include <exception>
 
-#include "Parser.h"
+#include "BulkBuilder.h"
 
 class Observer;
+struct ThreadMetrics;
 
 class Handler {
-  using Commands = std::vector<std::string>;
-
   std::vector<std::weak_ptr<Observer>> writers;
-  std::shared_ptr<Commands> commands;
-  BlockParser parser;
-  int N = 0;
-  int max_size_commad = 50;
+  BulkBuilder builder;
+  int size = 0;
+  std::ostream* report = nullptr;
+
+  // max delay timer: ticks counts timer periods, so a new bulk only reads an atomic
+  std::mutex mutex;
+  std::thread timer;
+  std::condition_variable timer_wake;
+  bool timer_stopped = false;
+  std::atomic<std::uint64_t> ticks{0};
+  std::uint64_t opened = 0;
+  std::uint64_t max_delay_ticks = 0;
+  // a writer error on the timer thread stops the timer, the next call on the Handler throws it
+  std::exception_ptr timer_error;
+
+  // adaptive static bulk size, moves between min_size and max_size after every static bulk
+  int min_size = 0;
+  int max_size = 0;
+  std::chrono::steady_clock::time_point filled;
+  std::map<int, std::size_t> sizes;
+
+  // bulks closed inside addCommands(), handed to the writers together at its end
+  // or once max_batch of them wait, so the pool still recycles them
+  static constexpr std::size_t max_batch = 32;
+  std::vector<BulkPtr> closed;
+  bool batching = false;
 
+  void add(std::string_view command, LineKind kind, ThreadMetrics& metrics);
   void print();
-  void update();
+  void dispatch();
+  void flush();
+  void tick(std::chrono::milliseconds period);
+  void stopTimer();
+  void rethrowTimerError();
+  void printStatic();
 public:
   Handler(const int& n);
+  ~Handler();
   void subscribe(const std::weak_ptr<Observer>& obs);
-  void addCommand(const std::string& command);
+  void addCommand(std::string_view command);
+  // same as addCommand() for every line, with one lock and one writer call per batch,
+  // kinds as for BulkBuilder::add(), nullptr classifies here
+  void addCommands(const std::string_view* lines, const LineKind* kinds, std::size_t count);
+  void addCommands(const std::vector<std::string_view>& lines) { addCommands(lines.data(), nullptr, lines.size()); }
+  void addCommands(const std::vector<std::string_view>& lines, const std::vector<LineKind>& kinds) { 
+    addCommands(lines.data(), kinds.data(), lines.size()); 
+  }
+  // prints the pending static bulk and drops an unclosed block, the writers are not waited for
+  void finish();
+  // finish() and flush every writer
   void stop();
+  // emit a static bulk at most delay after its first command, even if it is not full
+  void setMaxDelay(std::chrono::milliseconds delay);
+  // let the static bulk size follow the input rate and the writers backlog
+  void setAdaptive(int min, int max);
+  // see BulkBuilder::setBlockMemory()
+  void setBlockMemory(std::size_t bytes) { builder.setBlockMemory(bytes); }
+  // static bulk sizes chosen so far and how many bulks each one closed
+  std::map<int, std::size_t> chosenSizes() const { return sizes; }
+  // print the runtime metrics to out on stop()
+  void setReport(std::ostream& out) { report = &out; }
+  bool inBlock() const { return builder.inBlock(); }
+  // bulks printed so far
+  std::size_t bulks() const { return builder.current().id; }
 };
 
-#endif
\ No newline at end of file
+#endif
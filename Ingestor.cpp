@@ -0,0 +1,103 @@
+#include "Ingestor.h"
+#include "Observer.h"
+#include "Metrics.h"
+
+#include <stdexcept>
+
+Ingestor::Ingestor(const std::vector<std::shared_ptr<Observer>>& writers_, int bulk)
+  : writers(writers_), handler(std::make_shared<Handler>(bulk)) {
+  for (auto& writer : writers) {
+    writer->subscribe(handler);
+  }
+  thread = std::thread(&Ingestor::run, this);
+}
+
+Ingestor::~Ingestor() {
+  try {
+    close();
+  } catch(...) {}
+  thread.join();
+}
+
+void Ingestor::submit(std::vector<std::string> lines, Callback done) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (closed) {
+      throw std::runtime_error("ingestor is closed");
+    }
+    batches.push_back(Batch{std::move(lines), std::move(done), Result(), nullptr});
+  }
+  wake.notify_one();
+}
+
+std::future<Ingestor::Result> Ingestor::submit(std::vector<std::string> lines) {
+  auto promise = std::make_shared<std::promise<Result>>();
+  auto future = promise->get_future();
+  submit(std::move(lines), [promise](const Result& result, std::exception_ptr error) {
+    if (error)
+      promise->set_exception(error);
+    else
+      promise->set_value(result);
+  });
+  return future;
+}
+
+std::future<void> Ingestor::close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (closed) {
+      throw std::runtime_error("ingestor is closed");
+    }
+    closed = true;
+  }
+  wake.notify_one();
+  return stopped.get_future();
+}
+
+void Ingestor::run() {
+  Metrics::setThreadName("ingest");
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;) {
+    wake.wait(lock, [this] { return closed || !batches.empty(); });
+    if (batches.empty())
+      break;
+    std::deque<Batch> taken;
+    taken.swap(batches);
+    lock.unlock();
+
+    for (auto& batch : taken) {
+      auto before = handler->bulks();
+      try {
+        for (auto& line : batch.lines) {
+          handler->addCommand(line);
+          batch.result.lines++;
+        }
+      } catch(...) {
+        batch.error = std::current_exception();
+      }
+      batch.result.bulks = handler->bulks() - before;
+    }
+    std::exception_ptr error;
+    try {
+      for (auto& writer : writers)
+        writer->flush();
+    } catch(...) {
+      error = std::current_exception();
+    }
+    for (auto& batch : taken) {
+      try {
+        batch.done(batch.result, batch.error ? batch.error : error);
+      } catch(...) {}
+    }
+
+    lock.lock();
+  }
+  lock.unlock();
+
+  try {
+    handler->stop();
+    stopped.set_value();
+  } catch(...) {
+    stopped.set_exception(std::current_exception());
+  }
+}
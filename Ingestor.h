@@ -0,0 +1,96 @@
+#ifndef ingestor_h
+#define ingestor_h
+
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include <thread>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+#include "Handler.h"
+
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#endif
+
+class Observer;
+
+// Non-blocking front of a Handler for services that embed bulk in their own event loop.
+// submit() only queues a batch of lines, an ingest thread feeds them to the Handler and
+// completes the batch once the writers have flushed every bulk its lines closed.
+// Batches queued together share one flush. Commands still waiting in an open bulk are
+// not part of a completion, close() persists them.
+class Ingestor {
+public:
+  struct Result {
+    std::size_t lines = 0;
+    // bulks closed by the lines of the batch
+    std::size_t bulks = 0;
+  };
+  using Callback = std::function<void(const Result&, std::exception_ptr)>;
+
+private:
+  struct Batch {
+    std::vector<std::string> lines;
+    Callback done;
+    Result result;
+    std::exception_ptr error;
+  };
+
+  std::vector<std::shared_ptr<Observer>> writers;
+  std::shared_ptr<Handler> handler;
+  std::deque<Batch> batches;
+  bool closed = false;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::promise<void> stopped;
+  std::thread thread;
+
+  void run();
+public:
+  Ingestor(const std::vector<std::shared_ptr<Observer>>& writers_, int bulk);
+  Ingestor(const Ingestor&) = delete;
+  Ingestor& operator=(const Ingestor&) = delete;
+  // closes and waits for the ingest thread, must not run on it
+  ~Ingestor();
+
+  // done runs on the ingest thread, errors of the lines come as the exception_ptr
+  void submit(std::vector<std::string> lines, Callback done);
+  std::future<Result> submit(std::vector<std::string> lines);
+  // prints the open bulk, flushes the writers and completes once that is done
+  std::future<void> close();
+
+#if defined(__cpp_impl_coroutine)
+  // co_await ingestor.submitAsync(lines), resumes on the ingest thread
+  class Awaitable {
+    Ingestor& ingestor;
+    std::vector<std::string> lines;
+    Result result;
+    std::exception_ptr error;
+  public:
+    Awaitable(Ingestor& ingestor_, std::vector<std::string> lines_)
+      : ingestor(ingestor_), lines(std::move(lines_)) {}
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+      ingestor.submit(std::move(lines), [this, handle](const Result& result_, std::exception_ptr error_) {
+        result = result_;
+        error = error_;
+        handle.resume();
+      });
+    }
+    Result await_resume() {
+      if (error)
+        std::rethrow_exception(error);
+      return result;
+    }
+  };
+
+  Awaitable submitAsync(std::vector<std::string> lines) { return Awaitable(*this, std::move(lines)); }
+#endif
+};
+
+#endif
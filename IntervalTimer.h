@@ -0,0 +1,72 @@
+#ifndef interval_timer_h
+#define interval_timer_h
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+// Calls tick every period on its own thread, so a writer's interval policy fires
+// while no bulk arrives. The writer takes lock() around its own calls and tick runs
+// under the same mutex, so the two never overlap. An error thrown by tick stops the
+// timer and is rethrown by the next lock(), on the writer's thread.
+class IntervalTimer {
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::thread thread;
+  bool stopped = false;
+  std::exception_ptr error;
+
+  void run(std::chrono::milliseconds period, std::function<void()> tick) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!wake.wait_for(lock, period, [this] { return stopped; })) {
+      try {
+        tick();
+      } catch(...) {
+        error = std::current_exception();
+        return;
+      }
+    }
+  }
+
+public:
+  IntervalTimer() = default;
+  IntervalTimer(const IntervalTimer&) = delete;
+  IntervalTimer& operator=(const IntervalTimer&) = delete;
+  ~IntervalTimer() { stop(); }
+
+  void start(std::chrono::milliseconds period, std::function<void()> tick) {
+    stop();
+    stopped = false;
+    thread = std::thread(&IntervalTimer::run, this, std::max(period, std::chrono::milliseconds(1)), std::move(tick));
+  }
+
+  void stop() {
+    if (!thread.joinable())
+      return;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopped = true;
+    }
+    wake.notify_all();
+    thread.join();
+  }
+
+  // not locked while no timer was started, the writer then stays single threaded
+  std::unique_lock<std::mutex> lock() {
+    if (!thread.joinable())
+      return std::unique_lock<std::mutex>();
+    std::unique_lock<std::mutex> lock(mutex);
+    if (error) {
+      auto e = error;
+      error = nullptr;
+      std::rethrow_exception(e);
+    }
+    return lock;
+  }
+};
+
+#endif
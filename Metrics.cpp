@@ -0,0 +1,167 @@
+#include "Metrics.h"
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+void ThreadMetrics::Histogram::add(std::chrono::steady_clock::duration duration) {
+  auto micros = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+  int bucket = 0;
+  while (bucket < size - 1 && micros > (1ll << bucket)) 
+    bucket++;
+  buckets[bucket].add();
+  count.add();
+  sum.add(micros);
+}
+
+// upper bound of the bucket holding the p-th quantile
+double ThreadMetrics::Histogram::percentile(double p) const {
+  auto total = count.get();
+  if (total == 0) 
+    return 0;
+  std::uint64_t seen = 0;
+  for (int bucket = 0; bucket < size; bucket++) {
+    seen += buckets[bucket].get();
+    if (seen >= p * total) 
+      return double(1ll << bucket);
+  }
+  return double(1ll << (size - 1));
+}
+
+//---------------------------------------------------------------------------------
+
+Metrics& Metrics::instance() {
+  static Metrics metrics;
+  return metrics;
+}
+
+ThreadMetrics& Metrics::local() {
+  thread_local ThreadMetrics* metrics = nullptr;
+  if (!metrics) {
+    auto& registry = instance();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.threads.emplace_back();
+    metrics = &registry.threads.back();
+    metrics->name = "thread" + std::to_string(registry.threads.size() - 1);
+  }
+  return *metrics;
+}
+
+void Metrics::setThreadName(const std::string& name) {
+  auto& metrics = local();
+  std::lock_guard<std::mutex> lock(instance().mutex);
+  metrics.name = name;
+}
+
+Metrics::Gauge Metrics::addGauge(const std::string& name, std::function<std::size_t()> gauge) {
+  std::lock_guard<std::mutex> lock(mutex);
+  return gauges.emplace(gauges.end(), name, std::move(gauge));
+}
+
+void Metrics::removeGauge(Gauge gauge) {
+  std::lock_guard<std::mutex> lock(mutex);
+  gauges.erase(gauge);
+}
+
+void Metrics::report(std::ostream& out) {
+  std::lock_guard<std::mutex> lock(mutex);
+  for(auto& thread : threads) {
+    if (!thread.lines.get() && !thread.bulks.get() && !thread.bytes.get() && !thread.write_latency.count.get() 
+        && !thread.sync_latency.count.get()) 
+      continue;
+    out << thread.name << ": " << thread.lines.get() << " lines, " << thread.commands.get() << " commands, " 
+      << thread.bulks.get() << " bulks, " << thread.bytes.get() << " bytes";
+    if (thread.spilled.get()) 
+      out << ", " << thread.spilled.get() << " bytes spilled";
+    if (thread.write_latency.count.get()) {
+      out << ", write p50 <=" << thread.write_latency.percentile(0.5) << "us p99 <=" 
+        << thread.write_latency.percentile(0.99) << "us";
+    }
+    if (thread.sync_latency.count.get()) {
+      out << ", " << thread.sync_latency.count.get() << " syncs p50 <=" << thread.sync_latency.percentile(0.5) 
+        << "us p99 <=" << thread.sync_latency.percentile(0.99) << "us";
+    }
+    out << std::endl;
+  }
+  for(auto& gauge : gauges) {
+    out << gauge.first << ": " << gauge.second() << " queued" << std::endl;
+  }
+}
+
+void Metrics::exportText(std::ostream& out) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto counter = [&](const char* name, ThreadMetrics::Counter ThreadMetrics::* field) {
+    out << "# TYPE bulk_" << name << "_total counter\n";
+    for(auto& thread : threads) {
+      out << "bulk_" << name << "_total{thread=\"" << thread.name << "\"} " << (thread.*field).get() << "\n";
+    }
+  };
+  counter("lines", &ThreadMetrics::lines);
+  counter("commands", &ThreadMetrics::commands);
+  counter("bulks", &ThreadMetrics::bulks);
+  counter("bytes", &ThreadMetrics::bytes);
+  counter("spilled_bytes", &ThreadMetrics::spilled);
+
+  auto histogram = [&](const std::string& name, ThreadMetrics::Histogram ThreadMetrics::* field) {
+    out << "# TYPE bulk_" << name << "_us histogram\n";
+    for(auto& thread : threads) {
+      auto& histogram = thread.*field;
+      std::uint64_t cumulative = 0;
+      for (int bucket = 0; bucket < ThreadMetrics::Histogram::size - 1; bucket++) {
+        cumulative += histogram.buckets[bucket].get();
+        out << "bulk_" << name << "_us_bucket{thread=\"" << thread.name << "\",le=\"" << (1ll << bucket) << "\"} " 
+          << cumulative << "\n";
+      }
+      out << "bulk_" << name << "_us_bucket{thread=\"" << thread.name << "\",le=\"+Inf\"} " << histogram.count.get() << "\n";
+      out << "bulk_" << name << "_us_sum{thread=\"" << thread.name << "\"} " << histogram.sum.get() << "\n";
+      out << "bulk_" << name << "_us_count{thread=\"" << thread.name << "\"} " << histogram.count.get() << "\n";
+    }
+  };
+  histogram("write_latency", &ThreadMetrics::write_latency);
+  histogram("sync_latency", &ThreadMetrics::sync_latency);
+
+  out << "# TYPE bulk_queue_depth gauge\n";
+  for(auto& gauge : gauges) {
+    out << "bulk_queue_depth{queue=\"" << gauge.first << "\"} " << gauge.second() << "\n";
+  }
+}
+
+void Metrics::exportFile(const std::string& path) {
+  auto temporary = path + ".tmp";
+  {
+    std::ofstream file(temporary);
+    if (!file) {
+      throw std::runtime_error("can not write " + temporary);
+    }
+    exportText(file);
+  }
+  std::rename(temporary.c_str(), path.c_str());
+}
+
+//---------------------------------------------------------------------------------
+
+MetricsExporter::MetricsExporter(const std::string& path_, std::chrono::milliseconds interval_) 
+  : path(path_), interval(interval_), thread(&MetricsExporter::run, this) {}
+
+MetricsExporter::~MetricsExporter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopped = true;
+  }
+  wake.notify_all();
+  thread.join();
+  try {
+    Metrics::instance().exportFile(path);
+  } catch(...) {}
+}
+
+void MetricsExporter::run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!wake.wait_for(lock, interval, [this] { return stopped; })) {
+    lock.unlock();
+    try {
+      Metrics::instance().exportFile(path);
+    } catch(...) {}
+    lock.lock();
+  }
+}
@@ -0,0 +1,94 @@
+#ifndef metrics_h
+#define metrics_h
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <condition_variable>
+
+// Counters of one thread. Only the owning thread writes them, so an increment is a
+// plain load and store, the atomics just let a reporter read them from another thread.
+struct alignas(64) ThreadMetrics {
+  class Counter {
+    std::atomic<std::uint64_t> value{0};
+  public:
+    void add(std::uint64_t n = 1) { value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    std::uint64_t get() const { return value.load(std::memory_order_relaxed); }
+  };
+
+  // power of two buckets of microseconds, bucket b holds (2^(b-1), 2^b] to match
+  // the inclusive le label, the last one takes everything above
+  struct Histogram {
+    static constexpr int size = 24;
+    Counter buckets[size];
+    Counter count;
+    Counter sum;
+
+    void add(std::chrono::steady_clock::duration duration);
+    double percentile(double p) const;
+  };
+
+  std::string name;
+  Counter lines;
+  Counter commands;
+  Counter bulks;
+  Counter bytes;
+  // bytes of dynamic blocks moved to spill files
+  Counter spilled;
+  Histogram write_latency;
+  Histogram sync_latency;
+};
+
+// Process-wide registry of per-thread counters and queue depth gauges.
+class Metrics {
+  std::mutex mutex;
+  std::list<ThreadMetrics> threads;
+  std::list<std::pair<std::string, std::function<std::size_t()>>> gauges;
+  Metrics() = default;
+public:
+  using Gauge = std::list<std::pair<std::string, std::function<std::size_t()>>>::iterator;
+
+  static Metrics& instance();
+  // counters of the calling thread, registered on first use
+  static ThreadMetrics& local();
+  static void setThreadName(const std::string& name);
+
+  Gauge addGauge(const std::string& name, std::function<std::size_t()> gauge);
+  void removeGauge(Gauge gauge);
+
+  void report(std::ostream& out);
+  void exportText(std::ostream& out);
+  void exportFile(const std::string& path);
+};
+
+// Measures the time until it goes out of scope into a histogram.
+class LatencyTimer {
+  ThreadMetrics::Histogram& histogram;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+public:
+  LatencyTimer(ThreadMetrics::Histogram& histogram_) : histogram(histogram_) {}
+  ~LatencyTimer() { histogram.add(std::chrono::steady_clock::now() - start); }
+};
+
+// Rewrites a Prometheus text file with the current metrics every interval.
+class MetricsExporter {
+  std::string path;
+  std::chrono::milliseconds interval;
+  bool stopped = false;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::thread thread;
+
+  void run();
+public:
+  MetricsExporter(const std::string& path_, std::chrono::milliseconds interval_);
+  ~MetricsExporter();
+};
+
+#endif
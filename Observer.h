@@ -4,20 +4,28 @@
 #include "Handler.h"
 
 class Observer : public std::enable_shared_from_this<Observer> {
-protected:
-  using Commands = std::vector<std::string>;
-  std::weak_ptr<Commands> _commands;
 public:
   void subscribe(const std::weak_ptr<Handler>& handler) {
     if (!handler.expired())
       handler.lock()->subscribe(shared_from_this());
   }
 
-  virtual void update(const std::weak_ptr<Commands>& commands) {
-    _commands = commands;
+  virtual void print(const BulkPtr& bulk) = 0;
+
+  // bulks closed by one Handler::addCommands() call, in order
+  virtual void printBatch(const std::vector<BulkPtr>& bulks) {
+    for (auto& bulk : bulks) 
+      print(bulk);
   }
 
-  virtual void print() = 0;
+  // called by Handler::stop(), returns once everything printed so far is written,
+  // and committed where the writer has a durability
+  virtual void flush() {}
+
+  // bulks handed over but not written yet, Handler grows adaptive bulks while writers lag
+  virtual std::size_t backlog() const { return 0; }
+
+  virtual ~Observer() = default;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -13,11 +13,146 @@ int start_parsing(int argc, char *argv[]) {
   return N;
 }
 
-BlockParser::Block BlockParser::parsing(const std::string& line) {
-  if (line.size() == 0) 
-    return Block::Command;
+static int parse_count(int argc, char *argv[], int& i) {
+  if (++i >= argc) {
+    throw std::runtime_error(std::string("The value is missing for ") + argv[i - 1]);
+  }
+  auto value = std::atoi(argv[i]);
+  if (value < 0 || std::string(argv[i]) != std::to_string(value)) {
+    throw std::runtime_error(std::string("Incorrect value for ") + argv[i - 1]);
+  }
+  return value;
+}
+
+FlushPolicy parse_flush_policy(const std::string& value) {
+  FlushPolicy policy;
+  if (value == "bulk") {
+    policy.mode = FlushPolicy::PerBulk;
+  } else if (value == "stop") {
+    policy.mode = FlushPolicy::OnStop;
+  } else {
+    auto is_interval = value.size() > 2 && value.compare(value.size() - 2, 2, "ms") == 0;
+    auto number = is_interval ? value.substr(0, value.size() - 2) : value;
+    auto count = std::atoi(number.c_str());
+    if (count <= 0 || number != std::to_string(count)) {
+      throw std::runtime_error("Incorrect flush policy " + value);
+    }
+    if (is_interval) {
+      policy.mode = FlushPolicy::Interval;
+      policy.interval = std::chrono::milliseconds(count);
+    } else {
+      policy.mode = FlushPolicy::EveryBulks;
+      policy.bulks = count;
+    }
+  }
+  return policy;
+}
+
+Durability parse_durability(const std::string& value) {
+  Durability durability;
+  if (value == "none") {
+    durability.mode = Durability::None;
+  } else if (value == "bulk") {
+    durability.mode = Durability::PerBulk;
+  } else if (value.compare(0, 6, "group:") == 0) {
+    durability.mode = Durability::Group;
+    durability.group = parse_flush_policy(value.substr(6));
+    if (durability.group.mode != FlushPolicy::EveryBulks && durability.group.mode != FlushPolicy::Interval) {
+      throw std::runtime_error("Incorrect durability " + value);
+    }
+  } else {
+    throw std::runtime_error("Incorrect durability " + value);
+  }
+  return durability;
+}
+
+Options parse_options(int argc, char *argv[]) {
+  Options options;
+  options.N = start_parsing(argc, argv);
+  for (int i = 2; i < argc; i++) {
+    std::string option(argv[i]);
+    if (option == "--file-threads") {
+      options.file_threads = parse_count(argc, argv, i);
+    } else if (option == "--segment-size") {
+      options.segment_size = parse_count(argc, argv, i);
+    } else if (option == "--segment-age") {
+      options.segment_age = parse_count(argc, argv, i);
+    } else if (option == "--queue-size") {
+      options.queue_size = parse_count(argc, argv, i);
+    } else if (option == "--backpressure") {
+      if (++i >= argc) {
+        throw std::runtime_error("The value is missing for " + option);
+      }
+      std::string value(argv[i]);
+      if (value == "block") {
+        options.backpressure = Backpressure::Block;
+      } else if (value == "drop") {
+        options.backpressure = Backpressure::DropOldest;
+      } else if (value == "spill") {
+        options.backpressure = Backpressure::Spill;
+      } else {
+        throw std::runtime_error("Incorrect backpressure " + value);
+      }
+    } else if (option == "--stats") {
+      options.stats = true;
+    } else if (option == "--io-uring") {
+      options.io_uring = true;
+    } else if (option == "--metrics-file") {
+      if (++i >= argc) {
+        throw std::runtime_error("The value is missing for " + option);
+      }
+      options.metrics_file = argv[i];
+    } else if (option == "--metrics-interval") {
+      options.metrics_interval = parse_count(argc, argv, i);
+      if (options.metrics_interval == 0) {
+        throw std::runtime_error("Incorrect value for " + option);
+      }
+    } else if (option == "--trace") {
+      if (++i >= argc) {
+        throw std::runtime_error("The value is missing for " + option);
+      }
+      options.trace_file = argv[i];
+    } else if (option == "--max-delay-ms") {
+      options.max_delay_ms = parse_count(argc, argv, i);
+    } else if (option == "--min-bulk") {
+      options.min_bulk = parse_count(argc, argv, i);
+    } else if (option == "--max-bulk") {
+      options.max_bulk = parse_count(argc, argv, i);
+    } else if (option == "--block-memory") {
+      options.block_memory = parse_count(argc, argv, i);
+    } else if (option == "--durability") {
+      if (++i >= argc) {
+        throw std::runtime_error("The value is missing for " + option);
+      }
+      options.durability = parse_durability(argv[i]);
+    } else if (option == "--compress") {
+      if (++i >= argc) {
+        throw std::runtime_error("The value is missing for " + option);
+      }
+      options.compression = Compressor::parse(argv[i]);
+    } else if (option == "--flush") {
+      if (++i >= argc) {
+        throw std::runtime_error("The value is missing for " + option);
+      }
+      options.flush = parse_flush_policy(argv[i]);
+    } else {
+      throw std::runtime_error("Unknown option " + option);
+    }
+  }
+  if (options.compression != Compressor::None && options.segment_size > 0) {
+    throw std::runtime_error("--compress applies to bulk files, not to segments");
+  }
+  if (options.max_bulk > 0 || options.min_bulk > 0) {
+    if (options.min_bulk == 0) options.min_bulk = 1;
+    if (options.max_bulk < options.min_bulk) {
+      throw std::runtime_error("--max-bulk must not be less than --min-bulk");
+    }
+  }
+  return options;
+}
 
-  if (line == "{") {
+BlockParser::Block BlockParser::parsing(LineKind kind) {
+  if (kind == LineKind::Open) {
     blocks_count++;
     if (blocks_count > 1) 
       return Block::Empty;
@@ -25,7 +160,7 @@ BlockParser::Block BlockParser::parsing(const std::string& line) {
       return Block::StartBlock;
   }
 
-  if(line == "}") {
+  if (kind == LineKind::Close) {
     if (blocks_count == 0) 
       return Block::Command;
 
@@ -2,6 +2,14 @@
 #define parser_h
 
 #include <string>
+#include <string_view>
+#include <ctime>
+
+#include "FlushPolicy.h"
+#include "Durability.h"
+#include "Compressor.h"
+#include "RingQueue.h"
+#include "Classifier.h"
 
 class BlockParser {
   int blocks_count = 0;
@@ -14,9 +22,33 @@ public:
     Empty
   };
 
-  Block parsing(const std::string& line);
+  Block parsing(std::string_view line) { return parsing(classify_line(line)); }
+  Block parsing(LineKind kind);
+  int depth() const { return blocks_count; }
+};
+
+struct Options {
+  int N = 0;
+  int file_threads = 0;
+  FlushPolicy flush;
+  Durability durability;
+  Compressor::Codec compression = Compressor::None;
+  std::size_t segment_size = 0;
+  std::time_t segment_age = 0;
+  std::size_t queue_size = 1024;
+  Backpressure backpressure = Backpressure::Block;
+  bool stats = false;
+  bool io_uring = false;
+  std::string metrics_file;
+  std::size_t metrics_interval = 1000;
+  std::string trace_file;
+  std::size_t max_delay_ms = 0;
+  std::size_t min_bulk = 0;
+  std::size_t max_bulk = 0;
+  std::size_t block_memory = 0;
 };
 
 int start_parsing(int argc, char *argv[]);
+Options parse_options(int argc, char *argv[]);
 
 #endif
@@ -0,0 +1,54 @@
+#ifndef queue_h
+#define queue_h
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+template<typename T>
+class BlockingQueue {
+  std::deque<T> items;
+  std::size_t capacity;
+  bool closed = false;
+  std::mutex mutex;
+  std::condition_variable not_empty;
+  std::condition_variable not_full;
+public:
+  BlockingQueue(std::size_t capacity_) : capacity(capacity_ ? capacity_ : 1) {}
+
+  // blocks while the queue is full, returns false once the queue is closed
+  bool push(T item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_full.wait(lock, [this] { return closed || items.size() < capacity; });
+    if (closed) 
+      return false;
+    items.push_back(std::move(item));
+    lock.unlock();
+    not_empty.notify_one();
+    return true;
+  }
+
+  // blocks while the queue is empty, returns false once it is closed and drained
+  bool pop(T& item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_empty.wait(lock, [this] { return closed || !items.empty(); });
+    if (items.empty()) 
+      return false;
+    item = std::move(items.front());
+    items.pop_front();
+    lock.unlock();
+    not_full.notify_one();
+    return true;
+  }
+
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      closed = true;
+    }
+    not_empty.notify_all();
+    not_full.notify_all();
+  }
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include "Reader.h"
+
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+LineReader::LineReader(int fd_, std::size_t chunk) : fd(fd_) {
+  struct stat info;
+  if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+    auto offset = lseek(fd, 0, SEEK_CUR);
+    auto mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (offset >= 0 && mapped != MAP_FAILED) {
+      madvise(mapped, info.st_size, MADV_SEQUENTIAL);
+      map = static_cast<const char*>(mapped);
+      map_size = info.st_size;
+      begin = offset;
+      end = map_size;
+      eof = true;
+      return;
+    }
+  }
+  buffer.resize(chunk ? chunk : 1);
+}
+
+LineReader::~LineReader() {
+  if (map) 
+    munmap(const_cast<char*>(map), map_size);
+}
+
+bool LineReader::fill() {
+  if (begin > 0) {
+    std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+    end -= begin;
+    begin = 0;
+  }
+  if (end == buffer.size()) 
+    buffer.resize(buffer.size() * 2);
+  for (;;) {
+    auto count = read(fd, buffer.data() + end, buffer.size() - end);
+    if (count > 0) {
+      end += count;
+      return true;
+    }
+    if (count == 0) {
+      eof = true;
+      return false;
+    }
+    if (errno != EINTR) 
+      throw std::system_error(errno, std::generic_category(), "read");
+  }
+}
+
+bool LineReader::next(std::string_view& line) {
+  const char* data = map ? map : buffer.data();
+  std::size_t scanned = begin;
+  for (;;) {
+    // memchr is the vectorized (SSE2/AVX2) newline scan of the C library
+    auto found = static_cast<const char*>(std::memchr(data + scanned, '\n', end - scanned));
+    if (found) {
+      auto size = found - (data + begin);
+      line = std::string_view(data + begin, size);
+      begin += size + 1;
+      return true;
+    }
+    if (eof) {
+      if (begin == end) 
+        return false;
+      line = std::string_view(data + begin, end - begin);
+      begin = end;
+      return true;
+    }
+    scanned = end - begin;
+    fill();
+    data = buffer.data();
+  }
+}
+
+bool LineReader::next(std::vector<std::string_view>& lines, std::vector<LineKind>& kinds, std::size_t max) {
+  lines.clear();
+  kinds.clear();
+  for (;;) {
+    const char* data = map ? map : buffer.data();
+    begin += classify_lines(data + begin, end - begin, lines, kinds, max);
+    if (!lines.empty()) 
+      return true;
+    if (eof) {
+      if (begin == end) 
+        return false;
+      lines.emplace_back(data + begin, end - begin);
+      kinds.push_back(classify_line(lines.back()));
+      begin = end;
+      return true;
+    }
+    // no complete line buffered, nothing taken yet can be moved by reading more
+    fill();
+  }
+}
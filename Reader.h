@@ -0,0 +1,32 @@
+#ifndef reader_h
+#define reader_h
+
+#include <string_view>
+#include <vector>
+
+#include "Classifier.h"
+
+// Splits a file descriptor into lines without copying them.
+// Regular files are mapped into memory, anything else is read in large chunks.
+// The views returned by next() stay valid until the following call.
+class LineReader {
+  int fd;
+  std::vector<char> buffer;
+  std::size_t begin = 0;
+  std::size_t end = 0;
+  const char* map = nullptr;
+  std::size_t map_size = 0;
+  bool eof = false;
+
+  bool fill();
+public:
+  LineReader(int fd_, std::size_t chunk = 1 << 16);
+  LineReader(const LineReader&) = delete;
+  LineReader& operator=(const LineReader&) = delete;
+  ~LineReader();
+  bool next(std::string_view& line);
+  // up to max lines that are already read, at least one, classified for Handler::addCommands()
+  bool next(std::vector<std::string_view>& lines, std::vector<LineKind>& kinds, std::size_t max = 1024);
+};
+
+#endif
@@ -0,0 +1,220 @@
+#ifndef ring_queue_h
+#define ring_queue_h
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+// What a producer does when the ring is full.
+enum class Backpressure {
+  Block,      // wait until a consumer frees a cell
+  DropOldest, // discard the oldest queued item to make room
+  Spill       // park the item in an unbounded overflow list, later items follow it there
+};
+
+// Bounded lock-free ring buffer (D. Vyukov's per-cell sequence scheme).
+// Producers never lock. With a single consumer the dequeue side needs no CAS either.
+// Threads only sleep on the mutex once the ring stays full or empty after a short spin.
+template<typename T>
+class RingQueue {
+  struct alignas(64) Cell {
+    std::atomic<std::size_t> sequence;
+    T value;
+  };
+
+  std::unique_ptr<Cell[]> cells;
+  std::size_t mask;
+  bool multi_consumer;
+  Backpressure policy;
+
+  alignas(64) std::atomic<std::size_t> head{0};
+  alignas(64) std::atomic<std::size_t> tail{0};
+  alignas(64) std::atomic<std::size_t> dropped_count{0};
+  std::atomic<std::size_t> spilled_count{0};
+  std::atomic<bool> closed{false};
+  std::atomic<int> sleeping_producers{0};
+  std::atomic<int> sleeping_consumers{0};
+
+  std::mutex spill_mutex;
+  std::deque<T> spill;
+
+  std::mutex wait_mutex;
+  std::condition_variable not_empty;
+  std::condition_variable not_full;
+
+  static constexpr int spins = 64;
+
+  static std::size_t round_up(std::size_t capacity) {
+    std::size_t size = 2;
+    while (size < capacity) 
+      size <<= 1;
+    return size;
+  }
+
+  bool available() const {
+    auto pos = tail.load(std::memory_order_acquire);
+    return cells[pos & mask].sequence.load(std::memory_order_acquire) == pos + 1 
+      || spilled_count.load(std::memory_order_acquire) > 0;
+  }
+
+  void wake(std::atomic<int>& sleepers, std::condition_variable& condition) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers.load(std::memory_order_relaxed) > 0) {
+      std::lock_guard<std::mutex> lock(wait_mutex);
+      condition.notify_all();
+    }
+  }
+
+  bool take(T& item) {
+    auto pos = tail.load(std::memory_order_relaxed);
+    for (;;) {
+      auto& cell = cells[pos & mask];
+      auto sequence = cell.sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos + 1);
+      if (diff == 0) {
+        if (!multi_consumer && policy != Backpressure::DropOldest) {
+          tail.store(pos + 1, std::memory_order_relaxed);
+        } else if (!tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          continue;
+        }
+        item = std::move(cell.value);
+        cell.value = T();
+        cell.sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+      }
+      if (diff < 0) 
+        return false;
+      pos = tail.load(std::memory_order_relaxed);
+    }
+  }
+
+public:
+  RingQueue(std::size_t capacity, bool multi_consumer_ = true, Backpressure policy_ = Backpressure::Block) 
+    : cells(new Cell[round_up(capacity)]), mask(round_up(capacity) - 1), 
+      multi_consumer(multi_consumer_), policy(policy_) {
+    for (std::size_t i = 0; i <= mask; i++) 
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  bool try_push(T& item) {
+    auto pos = head.load(std::memory_order_relaxed);
+    for (;;) {
+      auto& cell = cells[pos & mask];
+      auto sequence = cell.sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+      if (diff == 0) {
+        if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.value = std::move(item);
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = head.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool try_pop(T& item) {
+    if (take(item)) 
+      return true;
+    if (spilled_count.load(std::memory_order_acquire) > 0) {
+      std::lock_guard<std::mutex> lock(spill_mutex);
+      if (!spill.empty()) {
+        item = std::move(spill.front());
+        spill.pop_front();
+        spilled_count.fetch_sub(1, std::memory_order_release);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // returns false once the queue is closed
+  bool push(T item) {
+    for (int attempt = 0; ; attempt++) {
+      if (closed.load(std::memory_order_acquire)) 
+        return false;
+      // consumers drain the ring before the overflow list, so while the list holds
+      // anything new items have to queue behind it to keep the order
+      if (policy == Backpressure::Spill && spilled_count.load(std::memory_order_acquire) > 0) {
+        std::lock_guard<std::mutex> lock(spill_mutex);
+        if (!spill.empty()) {
+          spill.push_back(std::move(item));
+          spilled_count.fetch_add(1, std::memory_order_release);
+          break;
+        }
+      }
+      if (try_push(item)) 
+        break;
+      if (policy == Backpressure::DropOldest) {
+        T oldest;
+        if (take(oldest)) 
+          dropped_count.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      if (policy == Backpressure::Spill) {
+        std::lock_guard<std::mutex> lock(spill_mutex);
+        spill.push_back(std::move(item));
+        spilled_count.fetch_add(1, std::memory_order_release);
+        break;
+      }
+      if (attempt < spins) {
+        std::this_thread::yield();
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(wait_mutex);
+      sleeping_producers.fetch_add(1);
+      not_full.wait(lock, [this] { 
+        auto pos = head.load(std::memory_order_relaxed);
+        return closed.load() || cells[pos & mask].sequence.load(std::memory_order_acquire) == pos; 
+      });
+      sleeping_producers.fetch_sub(1);
+    }
+    wake(sleeping_consumers, not_empty);
+    return true;
+  }
+
+  // blocks while the queue is empty, returns false once it is closed and drained
+  bool pop(T& item) {
+    for (int attempt = 0; ; attempt++) {
+      if (try_pop(item)) {
+        wake(sleeping_producers, not_full);
+        return true;
+      }
+      if (closed.load(std::memory_order_acquire) && !available()) 
+        return false;
+      if (attempt < spins) {
+        std::this_thread::yield();
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(wait_mutex);
+      sleeping_consumers.fetch_add(1);
+      not_empty.wait(lock, [this] { return closed.load() || available(); });
+      sleeping_consumers.fetch_sub(1);
+    }
+  }
+
+  void close() {
+    closed.store(true);
+    std::lock_guard<std::mutex> lock(wait_mutex);
+    not_empty.notify_all();
+    not_full.notify_all();
+  }
+
+  std::size_t dropped() const {
+    return dropped_count.load(std::memory_order_relaxed);
+  }
+
+  std::size_t size() const {
+    auto begin = tail.load(std::memory_order_relaxed);
+    auto queued = head.load(std::memory_order_relaxed) - begin;
+    return queued + spilled_count.load(std::memory_order_relaxed);
+  }
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "Server.h"
+
+#include <array>
+#include <cstdio>
+#include <iostream>
+
+namespace asio = boost::asio;
+
+// One connection. Each completed read goes straight to the Dispatcher, the session
+// lives as long as a read is pending and disconnects its context when it goes away.
+template<typename Socket>
+class Session : public std::enable_shared_from_this<Session<Socket>> {
+  Socket socket;
+  Dispatcher& dispatcher;
+  Dispatcher::handle_t handle;
+  std::atomic<std::size_t>& active;
+  std::array<char, 1 << 16> buffer;
+public:
+  Session(Socket socket_, Dispatcher& dispatcher_, std::size_t bulk, std::atomic<std::size_t>& active_)
+    : socket(std::move(socket_)), dispatcher(dispatcher_), active(active_) {
+    handle = dispatcher.connect(bulk);
+    active++;
+  }
+
+  ~Session() {
+    try {
+      dispatcher.disconnect(handle);
+    } catch(...) {}
+    active--;
+  }
+
+  void read() {
+    auto self = this->shared_from_this();
+    socket.async_read_some(asio::buffer(buffer), [self](const boost::system::error_code& error, std::size_t size) {
+      try {
+        if (size > 0)
+          self->dispatcher.receive(self->handle, self->buffer.data(), size);
+      } catch(const std::exception& e) {
+        // a bad stream only costs its own connection
+        std::cerr << e.what() << std::endl;
+        return;
+      }
+      if (!error)
+        self->read();
+    });
+  }
+};
+
+//---------------------------------------------------------------------------------
+
+BulkServer::BulkServer(const std::vector<std::shared_ptr<Observer>>& writers, std::size_t bulk_)
+  : dispatcher(writers), bulk(bulk_), tcp(io), local(io) {}
+
+BulkServer::~BulkServer() {
+  if (!socket_path.empty())
+    std::remove(socket_path.c_str());
+}
+
+unsigned short BulkServer::listen(unsigned short port) {
+  asio::ip::tcp::endpoint endpoint(asio::ip::tcp::v4(), port);
+  tcp.open(endpoint.protocol());
+  tcp.set_option(asio::socket_base::reuse_address(true));
+  tcp.bind(endpoint);
+  tcp.listen(asio::socket_base::max_listen_connections);
+  accept(tcp);
+  return tcp.local_endpoint().port();
+}
+
+void BulkServer::listen(const std::string& path) {
+  std::remove(path.c_str());
+  asio::local::stream_protocol::endpoint endpoint(path);
+  local.open(endpoint.protocol());
+  local.bind(endpoint);
+  local.listen(asio::socket_base::max_listen_connections);
+  socket_path = path;
+  accept(local);
+}
+
+template<typename Acceptor>
+void BulkServer::accept(Acceptor& acceptor) {
+  acceptor.async_accept([this, &acceptor](const boost::system::error_code& error, typename Acceptor::protocol_type::socket socket) {
+    if (error == asio::error::operation_aborted)
+      return;
+    if (!error) {
+      accepted++;
+      using Socket = typename Acceptor::protocol_type::socket;
+      std::make_shared<Session<Socket>>(std::move(socket), dispatcher, bulk, active)->read();
+    }
+    accept(acceptor);
+  });
+}
+
+void BulkServer::run() {
+  io.run();
+}
+
+void BulkServer::stop() {
+  asio::post(io, [this] {
+    boost::system::error_code ignored;
+    tcp.close(ignored);
+    local.close(ignored);
+    io.stop();
+  });
+}
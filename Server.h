@@ -0,0 +1,51 @@
+#ifndef server_h
+#define server_h
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+
+// asio of Boost 1.74 uses std::exchange without <utility> when built as C++20
+#include <boost/asio.hpp>
+
+#include "Dispatcher.h"
+
+// Accepts command streams over TCP or a Unix socket on one Boost.Asio event loop.
+// Every connection gets its own Dispatcher context, so dynamic blocks stay per connection
+// while all connections share the writers. Closing a connection flushes its context.
+class BulkServer {
+  Dispatcher dispatcher;
+  std::size_t bulk;
+  std::atomic<std::size_t> accepted{0};
+  std::atomic<std::size_t> active{0};
+  std::string socket_path;
+  boost::asio::io_context io;
+  boost::asio::ip::tcp::acceptor tcp;
+  boost::asio::local::stream_protocol::acceptor local;
+
+  template<typename Acceptor>
+  void accept(Acceptor& acceptor);
+public:
+  BulkServer(const std::vector<std::shared_ptr<Observer>>& writers, std::size_t bulk_);
+  BulkServer(const BulkServer&) = delete;
+  BulkServer& operator=(const BulkServer&) = delete;
+  ~BulkServer();
+
+  // listens on all addresses, port 0 picks a free one, returns the bound port
+  unsigned short listen(unsigned short port);
+  // listens on a Unix socket at path, replacing a stale socket file
+  void listen(const std::string& path);
+  // caps the memory an unclosed { } block of one connection may take
+  void setBlockMemory(std::size_t bytes) { dispatcher.setBlockMemory(bytes); }
+  // serves connections until stop()
+  void run();
+  // may be called from any thread
+  void stop();
+
+  std::size_t getAccepted() const { return accepted.load(); }
+  std::size_t getActive() const { return active.load(); }
+};
+
+#endif
@@ -0,0 +1,62 @@
+#include "Spill.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+Spill::Spill() : directory(std::filesystem::temp_directory_path().string()) {
+#ifdef O_TMPFILE
+  fd = open(directory.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+#endif
+  if (fd < 0) {
+    // no O_TMPFILE on this file system, a named file unlinked right away does the same
+    std::string path = directory + "/bulk_spill_XXXXXX";
+    std::vector<char> buffer(path.begin(), path.end());
+    buffer.push_back('\0');
+    fd = mkstemp(buffer.data());
+    if (fd < 0) 
+      throw std::system_error(errno, std::generic_category(), "mkstemp " + path);
+    unlink(buffer.data());
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+  }
+}
+
+Spill::~Spill() {
+  if (map) 
+    munmap(map, size);
+  close(fd);
+}
+
+void Spill::append(std::string_view text) {
+  if (map) 
+    throw std::runtime_error("spill is finished");
+  auto data = text.data();
+  auto left = text.size();
+  while (left > 0) {
+    auto count = pwrite(fd, data, left, size);
+    if (count < 0 && errno == EINTR) 
+      continue;
+    if (count < 0) 
+      throw std::system_error(errno, std::generic_category(), "write spill in " + directory);
+    data += count;
+    left -= count;
+    size += count;
+  }
+}
+
+void Spill::finish() {
+  if (map || size == 0) 
+    return;
+  auto mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (mapped == MAP_FAILED) 
+    throw std::system_error(errno, std::generic_category(), "mmap spill in " + directory);
+  madvise(mapped, size, MADV_SEQUENTIAL);
+  map = static_cast<char*>(mapped);
+}
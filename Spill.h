@@ -0,0 +1,29 @@
+#ifndef spill_h
+#define spill_h
+
+#include <string>
+#include <string_view>
+
+// Rendered text of a dynamic block that outgrew its memory cap, kept in an unlinked
+// temporary file under TMPDIR. Appends are plain writes, finish() maps the whole text
+// read-only, so a huge bulk sits in page cache the kernel can write back and drop
+// instead of the heap. The file goes away with the last reference to the Spill.
+class Spill {
+  int fd = -1;
+  std::string directory;
+  std::size_t size = 0;
+  char* map = nullptr;
+public:
+  Spill();
+  Spill(const Spill&) = delete;
+  Spill& operator=(const Spill&) = delete;
+  ~Spill();
+
+  void append(std::string_view text);
+  // maps everything appended so far, nothing may be appended afterwards
+  void finish();
+  std::string_view view() const { return std::string_view(map, map ? size : 0); }
+  std::size_t getSize() const { return size; }
+};
+
+#endif
@@ -0,0 +1,65 @@
+#include "Tracer.h"
+#include "Metrics.h"
+
+#include <fstream>
+#include <stdexcept>
+
+std::atomic<bool> Tracer::active{false};
+
+Tracer& Tracer::instance() {
+  static Tracer tracer;
+  return tracer;
+}
+
+void Tracer::start() {
+  std::lock_guard<std::mutex> lock(mutex);
+  events.clear();
+  origin = Clock::now();
+  active.store(true);
+}
+
+void Tracer::stop() {
+  active.store(false);
+}
+
+// called with the mutex held, threads are named after their metrics
+int Tracer::thread() {
+  thread_local int id = -1;
+  if (id < 0) {
+    id = threads.size();
+    threads.push_back(Metrics::local().name);
+  }
+  return id;
+}
+
+void Tracer::complete(const char* name, std::size_t bulk, std::size_t commands, 
+  Clock::time_point begin, Clock::time_point end) {
+  std::lock_guard<std::mutex> lock(mutex);
+  events.push_back(Event{name, bulk, commands, thread(), begin, end});
+}
+
+void Tracer::write(std::ostream& out) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto micros = [this](Clock::time_point time) {
+    return std::chrono::duration<double, std::micro>(time - origin).count();
+  };
+  out << "{\"traceEvents\":[";
+  for (std::size_t i = 0; i < threads.size(); i++) {
+    out << (i ? ",\n" : "\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i 
+      << ",\"args\":{\"name\":\"" << threads[i] << "\"}}";
+  }
+  for(auto& event : events) {
+    out << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"bulk\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread 
+      << ",\"ts\":" << micros(event.begin) << ",\"dur\":" << micros(event.end) - micros(event.begin) 
+      << ",\"args\":{\"bulk\":" << event.bulk << ",\"commands\":" << event.commands << "}}";
+  }
+  out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+void Tracer::writeFile(const std::string& path) {
+  std::ofstream file(path);
+  if (!file) {
+    throw std::runtime_error("can not write " + path);
+  }
+  write(file);
+}
@@ -0,0 +1,54 @@
+#ifndef tracer_h
+#define tracer_h
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Per-bulk timeline in the Chrome trace event format (chrome://tracing, Perfetto).
+// Built without BULK_TRACING every enabled() check is a constant false and the
+// tracing code drops out, otherwise it costs one relaxed load per bulk until start().
+class Tracer {
+public:
+  using Clock = std::chrono::steady_clock;
+private:
+  struct Event {
+    const char* name;
+    std::size_t bulk;
+    std::size_t commands;
+    int thread;
+    Clock::time_point begin;
+    Clock::time_point end;
+  };
+
+  static std::atomic<bool> active;
+  std::mutex mutex;
+  std::vector<Event> events;
+  std::vector<std::string> threads;
+  Clock::time_point origin = Clock::now();
+
+  Tracer() = default;
+  int thread();
+public:
+  static Tracer& instance();
+
+  static bool enabled() {
+#ifdef BULK_TRACING
+    return active.load(std::memory_order_relaxed);
+#else
+    return false;
+#endif
+  }
+
+  void start();
+  void stop();
+  void complete(const char* name, std::size_t bulk, std::size_t commands, 
+    Clock::time_point begin, Clock::time_point end);
+  void write(std::ostream& out);
+  void writeFile(const std::string& path);
+};
+
+#endif
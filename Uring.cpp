@@ -0,0 +1,202 @@
+#include "Uring.h"
+
+#include <system_error>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#ifdef BULK_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+enum Op { Open, Write, Sync, Close };
+
+static int io_uring_setup(unsigned entries, io_uring_params* params) {
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+  return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void* arg, unsigned count) {
+  return syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+// the ring indexes are shared with the kernel
+static unsigned load_acquire(const unsigned* index) {
+  return __atomic_load_n(index, __ATOMIC_ACQUIRE);
+}
+
+static void store_release(unsigned* index, unsigned value) {
+  __atomic_store_n(index, value, __ATOMIC_RELEASE);
+}
+
+template<typename T>
+static T* at(void* ring, unsigned offset) {
+  return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+
+//-----------------------------------------------------------------------------------------------
+
+Uring::Uring() {
+  io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  fd = io_uring_setup(batch * 4, &params);
+  if (fd < 0)
+    throw std::system_error(errno, std::generic_category(), "io_uring_setup");
+
+  sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+    sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+
+  sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (sq_ring == MAP_FAILED) {
+    sq_ring = nullptr;
+    auto error = errno;
+    release();
+    throw std::system_error(error, std::generic_category(), "mmap io_uring");
+  }
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    cq_ring = sq_ring;
+  } else {
+    cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+  }
+  sqes = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (cq_ring == MAP_FAILED || sqes == MAP_FAILED) {
+    auto error = errno;
+    if (cq_ring == MAP_FAILED) cq_ring = nullptr;
+    if (sqes == MAP_FAILED) sqes = nullptr;
+    release();
+    throw std::system_error(error, std::generic_category(), "mmap io_uring");
+  }
+
+  sq_head = at<unsigned>(sq_ring, params.sq_off.head);
+  sq_tail = at<unsigned>(sq_ring, params.sq_off.tail);
+  sq_mask = at<unsigned>(sq_ring, params.sq_off.ring_mask);
+  sq_array = at<unsigned>(sq_ring, params.sq_off.array);
+  cq_head = at<unsigned>(cq_ring, params.cq_off.head);
+  cq_tail = at<unsigned>(cq_ring, params.cq_off.tail);
+  cq_mask = at<unsigned>(cq_ring, params.cq_off.ring_mask);
+  cqes = at<io_uring_cqe>(cq_ring, params.cq_off.cqes);
+
+  // one empty slot per file of a batch, openat installs the new file there directly
+  io_uring_rsrc_register files;
+  std::memset(&files, 0, sizeof(files));
+  files.nr = batch;
+  files.flags = IORING_RSRC_REGISTER_SPARSE;
+  if (io_uring_register(fd, IORING_REGISTER_FILES2, &files, sizeof(files)) < 0) {
+    auto error = errno;
+    release();
+    throw std::system_error(error, std::generic_category(), "io_uring_register");
+  }
+}
+
+Uring::~Uring() {
+  release();
+}
+
+void Uring::release() {
+  if (sqes)
+    munmap(sqes, sqes_size);
+  if (cq_ring && cq_ring != sq_ring)
+    munmap(cq_ring, cq_ring_size);
+  if (sq_ring)
+    munmap(sq_ring, sq_ring_size);
+  if (fd >= 0)
+    close(fd);
+  sqes = cq_ring = sq_ring = nullptr;
+  fd = -1;
+}
+
+void Uring::submit(File* files, std::size_t count, bool sync) {
+  auto tail = *sq_tail;
+  auto entries = static_cast<io_uring_sqe*>(sqes);
+  auto add = [&](Op op, std::size_t file) {
+    auto index = tail & *sq_mask;
+    auto sqe = &entries[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = file * 4 + op;
+    sq_array[index] = index;
+    tail++;
+    return sqe;
+  };
+
+  for (std::size_t i = 0; i < count; i++) {
+    auto& file = files[i];
+    file.opened = file.written = file.synced = file.closed = 0;
+    // hard links keep the chain going after a failure, so close always runs on the slot
+    auto sqe = add(Open, i);
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<std::uintptr_t>(file.name);
+    sqe->len = 0644;
+    sqe->open_flags = file.flags;
+    sqe->file_index = i + 1;
+    sqe->flags = IOSQE_IO_HARDLINK;
+
+    sqe = add(Write, i);
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = i;
+    sqe->addr = reinterpret_cast<std::uintptr_t>(file.data);
+    sqe->len = file.size;
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+
+    if (sync) {
+      sqe = add(Sync, i);
+      sqe->opcode = IORING_OP_FSYNC;
+      sqe->fd = i;
+      sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+    }
+
+    sqe = add(Close, i);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = i + 1;
+  }
+
+  auto submitted = tail - *sq_tail;
+  store_release(sq_tail, tail);
+
+  unsigned completed = 0;
+  while (completed < submitted) {
+    auto pending = *sq_tail - load_acquire(sq_head);
+    if (io_uring_enter(fd, pending, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR && errno != EAGAIN)
+      throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+
+    auto head = *cq_head;
+    auto ready = load_acquire(cq_tail);
+    for (; head != ready; head++, completed++) {
+      auto& cqe = static_cast<io_uring_cqe*>(cqes)[head & *cq_mask];
+      auto& file = files[cqe.user_data / 4];
+      switch(cqe.user_data % 4)
+      {
+        case Open: file.opened = cqe.res; break;
+        case Write: file.written = cqe.res; break;
+        case Sync: file.synced = cqe.res; break;
+        default: file.closed = cqe.res; break;
+      }
+    }
+    store_release(cq_head, head);
+  }
+}
+
+#else
+
+Uring::Uring() {
+  throw std::system_error(ENOSYS, std::generic_category(), "io_uring is not built in");
+}
+
+Uring::~Uring() {}
+
+void Uring::release() {}
+
+void Uring::submit(File*, std::size_t, bool) {}
+
+#endif
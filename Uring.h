@@ -0,0 +1,56 @@
+#ifndef uring_h
+#define uring_h
+
+#include <cstddef>
+#include <vector>
+
+// Creates, writes and closes batches of files through io_uring, talking to the kernel
+// with the raw syscalls (no liburing). Every file is one hard linked chain
+// openat -> write -> [fsync] -> close on a registered file slot, so the descriptor never
+// reaches user space and a whole batch costs a single io_uring_enter().
+// Construction throws std::system_error when the kernel does not support this.
+class Uring {
+public:
+  struct File {
+    const char* name;
+    const char* data;
+    std::size_t size;
+    int flags;
+    // results of the chain, negative errno on failure
+    int opened = 0;
+    int written = 0;
+    int synced = 0;
+    int closed = 0;
+  };
+
+  static constexpr unsigned batch = 64;
+
+  Uring();
+  Uring(const Uring&) = delete;
+  Uring& operator=(const Uring&) = delete;
+  ~Uring();
+
+  // runs the chains of up to batch files and fills in their results
+  void submit(File* files, std::size_t count, bool sync);
+
+private:
+  int fd = -1;
+  void* sq_ring = nullptr;
+  void* cq_ring = nullptr;
+  void* sqes = nullptr;
+  std::size_t sq_ring_size = 0;
+  std::size_t cq_ring_size = 0;
+  std::size_t sqes_size = 0;
+  unsigned* sq_head = nullptr;
+  unsigned* sq_tail = nullptr;
+  unsigned* sq_mask = nullptr;
+  unsigned* sq_array = nullptr;
+  unsigned* cq_head = nullptr;
+  unsigned* cq_tail = nullptr;
+  unsigned* cq_mask = nullptr;
+  void* cqes = nullptr;
+
+  void release();
+};
+
+#endif
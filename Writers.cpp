@@ -1,6 +1,70 @@
 #include "Writers.h"
+#include "Metrics.h"
+#include "Uring.h"
 
 #include <iostream>
+#include <atomic>
+#include <algorithm>
+#include <system_error>
+#include <cerrno>
+#include <exception>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// Handler renders every bulk once when it closes, bulks built elsewhere are rendered here.
+static BulkPtr rendered(const BulkPtr& bulk) {
+  auto copy = std::make_shared<Bulk>(*bulk);
+  copy->render();
+  return copy;
+}
+
+// A writer's timer checks its interval policies eight times per the shortest one,
+// milliseconds::max() when the writer has none and needs no timer.
+static std::chrono::milliseconds tick_period(const FlushPolicy& policy, const Durability& durability = Durability()) {
+  auto period = std::chrono::milliseconds::max();
+  if (policy.mode == FlushPolicy::Interval) 
+    period = std::min(period, policy.interval);
+  if (durability.mode == Durability::Group && durability.group.mode == FlushPolicy::Interval) 
+    period = std::min(period, durability.group.interval);
+  return period == std::chrono::milliseconds::max() ? period : period / 8;
+}
+
+static void sync_fd(int fd, const std::string& name) {
+  LatencyTimer timer(Metrics::local().sync_latency);
+  if (fsync(fd) < 0) {
+    auto error = errno;
+    close(fd);
+    throw std::system_error(error, std::generic_category(), "fsync " + name);
+  }
+}
+
+// fsync applies to the file, not to the descriptor, so a fresh one will do
+static void sync_path(const std::string& name, int flags = O_RDONLY) {
+  int fd = open(name.c_str(), flags | O_CLOEXEC);
+  if (fd < 0) 
+    throw std::system_error(errno, std::generic_category(), "open " + name);
+  sync_fd(fd, name);
+  close(fd);
+}
+
+// false when name exists already
+static bool create_exclusive(const std::string& name) {
+  int fd = open(name.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd < 0 && errno == EEXIST) 
+    return false;
+  if (fd < 0) 
+    throw std::system_error(errno, std::generic_category(), "open " + name);
+  close(fd);
+  return true;
+}
+
+// new files are only durable once their directory entry is
+static void sync_directory() {
+  sync_path(".", O_RDONLY | O_DIRECTORY);
+}
+
+//---------------------------------------------------------------------------------
 
 ConsoleWriter::ConsoleWriter() {
   out = &std::cout;
@@ -10,60 +74,273 @@ ConsoleWriter::ConsoleWriter(std::ostream& out_stream) {
   out = &out_stream;
 }
 
-void ConsoleWriter::print() {
-  if (_commands.expired()) {
+ConsoleWriter::ConsoleWriter(std::ostream& out_stream, const FlushPolicy& policy_) : policy(policy_) {
+  out = &out_stream;
+  auto period = tick_period(policy);
+  if (period != std::chrono::milliseconds::max()) {
+    interval_timer.start(period, [this] {
+      if (pending && policy.due(pending, last_flush)) 
+        writeBuffer();
+    });
+  }
+}
+
+ConsoleWriter::~ConsoleWriter() {
+  interval_timer.stop();
+  try {
+    flush();
+  } catch(...) {}
+}
+
+void ConsoleWriter::print(const BulkPtr& bulk) {
+  if (!bulk) {
     throw std::runtime_error("commands do not exist");
   }
-  auto commands = _commands.lock();
-  *out << "bulk: ";
-  for(auto command = commands->cbegin(); command < commands->cend(); command++) {
-    if (command != commands->cbegin())
-      *out << ", ";
-    *out << *command;
+  if (bulk->output().empty()) 
+    return print(rendered(bulk));
+  auto lock = interval_timer.lock();
+  if (bulk->spill) {
+    // a spilled block is written from its mapping rather than copied into the buffer
+    writeBuffer();
+    auto& metrics = Metrics::local();
+    LatencyTimer timer(metrics.write_latency);
+    auto text = bulk->output();
+    out->write(text.data(), text.size());
+    out->flush();
+    metrics.bytes.add(text.size());
+    return;
+  }
+  buffer += bulk->text;
+  pending++;
+  if (policy.due(pending, last_flush)) 
+    writeBuffer();
+}
+
+void ConsoleWriter::flush() {
+  auto lock = interval_timer.lock();
+  writeBuffer();
+}
+
+void ConsoleWriter::writeBuffer() {
+  if (!buffer.empty()) {
+    auto& metrics = Metrics::local();
+    LatencyTimer timer(metrics.write_latency);
+    out->write(buffer.data(), buffer.size());
+    metrics.bytes.add(buffer.size());
+    buffer.clear();
   }
-  *out << std::endl;
+  out->flush();
+  pending = 0;
+  last_flush = std::chrono::steady_clock::now();
 }
 
 //---------------------------------------------------------------------------------
 
 FileWriter::FileWriter() {
-  file.exceptions ( std::ifstream::failbit | std::ifstream::badbit );
+  static std::atomic<std::size_t> writers{0};
+  writer = writers++;
+}
+
+FileWriter::FileWriter(const FlushPolicy& policy_, Backend backend, const Durability& durability_, 
+  Compressor::Codec codec) : FileWriter() {
+  policy = policy_;
+  durability = durability_;
+  if (codec != Compressor::None) 
+    compressor = std::make_unique<Compressor>(codec);
+  if (backend == Backend::Uring) {
+    try {
+      uring = std::make_unique<Uring>();
+    } catch(const std::system_error&) {}
+  }
+  auto period = tick_period(policy, durability);
+  if (period != std::chrono::milliseconds::max()) {
+    interval_timer.start(period, [this] {
+      if (!files.empty() && policy.due(files.size(), last_flush)) 
+        writeFiles();
+      if (!unsynced.empty() && durability.group.due(unsynced.size(), last_sync)) 
+        sync();
+    });
+  }
+}
+
+FileWriter::~FileWriter() {
+  interval_timer.stop();
+  try {
+    flush();
+  } catch(...) {}
 }
 
-void FileWriter::update(const std::weak_ptr<Commands>& commands) {
-  if (commands.expired()) {
+std::string FileWriter::makeName(std::time_t time_) {
+  auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+  clock = std::max(now, clock + 1);
+  std::stringbuf out_buffer;
+  std::ostream out_stream(&out_buffer);
+  out_stream << "bulk_" << time_ << "_" << clock << "_" << getpid() << "_" << writer << ".log";
+  if (compressor) 
+    out_stream << Compressor::extension(compressor->getCodec());
+  return out_buffer.str();
+}
+
+void FileWriter::print(const BulkPtr& bulk) {
+  if (!bulk) {
     throw std::runtime_error("commands do not exist");
   }
-  if (commands.lock()->size() == 1) {
-    std::stringbuf out_buffer;
-    std::ostream out_stream(&out_buffer);
-    auto time_ = time;
-    auto current_time = std::time(&time);
-    if (time_ == current_time) {
-      section++;
-    } else {
-      section = 0;
+  if (bulk->output().empty()) 
+    return print(rendered(bulk));
+  auto lock = interval_timer.lock();
+  time = bulk->time;
+  name = makeName(time);
+  if (bulk->spill) 
+    files.push_back(File{name, std::string(), time, false, bulk->spill});
+  else 
+    files.push_back(File{name, std::string(bulk->body()), time, false, nullptr});
+  if (policy.due(files.size(), last_flush)) 
+    writeFiles();
+}
+
+static void write_all(int fd, const char* data, std::size_t left, off_t offset, const std::string& name) {
+  while (left > 0) {
+    auto count = pwrite(fd, data, left, offset);
+    if (count < 0 && errno == EINTR) 
+      continue;
+    if (count < 0) {
+      auto error = errno;
+      close(fd);
+      throw std::system_error(error, std::generic_category(), "write " + name);
     }
-    out_stream << "bulk_" << section << "_";
-    out_stream << current_time << ".log";
-    name = out_buffer.str();
+    data += count;
+    left -= count;
+    offset += count;
   }
-  Observer::update(commands);
-} 
+}
 
-void FileWriter::print() {
-  if (_commands.expired()) {
-    throw std::runtime_error("commands do not exist");
+void FileWriter::write(File& file) {
+  int fd;
+  while ((fd = open(file.name.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644)) < 0) {
+    if (errno != EEXIST) 
+      throw std::system_error(errno, std::generic_category(), "open " + file.name);
+    auto renamed = makeName(file.time);
+    if (file.name == name) 
+      name = renamed;
+    file.name = renamed;
+  }
+  auto data = file.data();
+  write_all(fd, data.data(), data.size(), 0, file.name);
+  if (durability.mode == Durability::PerBulk) 
+    sync_fd(fd, file.name);
+  close(fd);
+}
+
+void FileWriter::flush() {
+  auto lock = interval_timer.lock();
+  writeFiles();
+  sync();
+}
+
+void FileWriter::writeFiles() {
+  auto count = files.size();
+  if (compressor) {
+    std::string frame;
+    for (auto& file : files) {
+      if (file.compressed) 
+        continue;
+      frame.clear();
+      compressor->compress(file.data(), frame);
+      file.content.assign(frame);
+      file.spill.reset();
+      file.compressed = true;
+    }
+  }
+  if (uring) 
+    flushUring();
+  auto& metrics = Metrics::local();
+  for(auto pending = files.begin(); pending != files.end(); pending = files.erase(pending)) {
+    LatencyTimer timer(metrics.write_latency);
+    write(*pending);
+    written(*pending);
   }
-  auto commands = _commands.lock();
-  file.open(name);
-  file << "bulk: ";
-  for(auto command = commands->cbegin(); command < commands->cend(); command++) {
-    if (command != commands->cbegin())
-      file << ", ";
-    file << *command;
+  last_flush = std::chrono::steady_clock::now();
+
+  if (durability.mode == Durability::PerBulk && count) {
+    sync_directory();
+  } else if (durability.mode == Durability::Group) {
+    if (!unsynced.empty() && durability.group.due(unsynced.size(), last_sync)) 
+      sync();
+  }
+}
+
+void FileWriter::written(const File& file) {
+  bytes += file.data().size();
+  Metrics::local().bytes.add(file.data().size());
+  if (durability.mode == Durability::Group) 
+    unsynced.push_back(file.name);
+}
+
+// The files of the group are fsynced one by one and their directory once after them.
+// Only this writer's data is waited for, a syncfs() would also wait for whatever
+// other processes left dirty on the same file system.
+void FileWriter::sync() {
+  if (unsynced.empty()) 
+    return;
+  for (auto& file : unsynced) 
+    sync_path(file);
+  sync_directory();
+  unsynced.clear();
+  last_sync = std::chrono::steady_clock::now();
+}
+
+// Name clashes go back to write() for a new name, a short write is finished with pwrite.
+void FileWriter::flushUring() {
+  auto& metrics = Metrics::local();
+  Uring::File batch[Uring::batch];
+  while (!files.empty()) {
+    auto count = std::min<std::size_t>(files.size(), Uring::batch);
+    // a direct descriptor never reaches user space, so there is nothing for O_CLOEXEC to do
+    for (std::size_t i = 0; i < count; i++) {
+      auto& file = files[i];
+      batch[i] = Uring::File{file.name.c_str(), file.data().data(), file.data().size(),
+        O_WRONLY | O_CREAT | O_EXCL};
+    }
+    {
+      LatencyTimer timer(metrics.write_latency);
+      uring->submit(batch, count, durability.mode == Durability::PerBulk);
+    }
+
+    // the whole batch has been tried, so it leaves the queue even if some file failed
+    std::exception_ptr error;
+    for (std::size_t i = 0; i < count; i++) {
+      auto& file = files[i];
+      auto& result = batch[i];
+      try {
+        if (result.opened == -EEXIST) {
+          write(file);
+        } else if (result.opened < 0) {
+          throw std::system_error(-result.opened, std::generic_category(), "open " + file.name);
+        } else if (result.written < 0 || result.closed < 0) {
+          auto code = result.written < 0 ? -result.written : -result.closed;
+          throw std::system_error(code, std::generic_category(), "write " + file.name);
+        } else if (std::size_t(result.written) < file.data().size()) {
+          int fd = open(file.name.c_str(), O_WRONLY | O_CLOEXEC);
+          if (fd < 0) 
+            throw std::system_error(errno, std::generic_category(), "open " + file.name);
+          write_all(fd, file.data().data() + result.written, file.data().size() - result.written, 
+            result.written, file.name);
+          // the chain's fsync ran before the rest was written
+          if (durability.mode == Durability::PerBulk) 
+            sync_fd(fd, file.name);
+          close(fd);
+        } else if (result.synced < 0) {
+          throw std::system_error(-result.synced, std::generic_category(), "fsync " + file.name);
+        }
+        written(file);
+      } catch(...) {
+        error = std::current_exception();
+      }
+    }
+    files.erase(files.begin(), files.begin() + count);
+    if (error) 
+      std::rethrow_exception(error);
   }
-  file.close();
 }
 
 std::string FileWriter::getName() {
@@ -72,4 +349,140 @@ std::string FileWriter::getName() {
 
 std::time_t FileWriter::getTime() {
   return time;
-}
\ No newline at end of file
+}
+
+std::size_t FileWriter::getBytes() {
+  return bytes;
+}
+
+//---------------------------------------------------------------------------------
+
+SegmentWriter::SegmentWriter(std::size_t max_size_, std::time_t max_age_, const FlushPolicy& policy_, 
+  const Durability& durability_) : max_size(max_size_), max_age(max_age_), policy(policy_), durability(durability_) {
+  log.exceptions ( std::ifstream::failbit | std::ifstream::badbit );
+  index.exceptions ( std::ifstream::failbit | std::ifstream::badbit );
+  auto period = tick_period(policy, durability);
+  if (period != std::chrono::milliseconds::max()) {
+    interval_timer.start(period, [this] {
+      if (pending && policy.due(pending, last_flush)) 
+        writeBuffers();
+      if (unsynced && durability.group.due(unsynced, last_sync)) 
+        sync();
+    });
+  }
+}
+
+SegmentWriter::~SegmentWriter() {
+  interval_timer.stop();
+  try {
+    flush();
+  } catch(...) {}
+}
+
+void SegmentWriter::rotate(std::time_t time) {
+  writeBuffers();
+  sync();
+  if (log.is_open()) {
+    log.close();
+    index.close();
+    segment++;
+  }
+  // both files are claimed with O_EXCL, so no other writer ever appends to them
+  for (;;) {
+    auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+    clock = std::max(now, clock + 1);
+    std::stringbuf out_buffer;
+    std::ostream out_stream(&out_buffer);
+    out_stream << "bulk_segment_" << time << "_" << clock << "_" << getpid() << "_" << segment;
+    name = out_buffer.str() + ".log";
+    if (!create_exclusive(name)) 
+      continue;
+    if (create_exclusive(getIndexName())) 
+      break;
+    std::remove(name.c_str());
+  }
+  log.open(name, std::ios::binary | std::ios::app);
+  index.open(getIndexName(), std::ios::binary | std::ios::app);
+  offset = 0;
+  opened = time;
+  created = true;
+}
+
+void SegmentWriter::print(const BulkPtr& bulk) {
+  if (!bulk) {
+    throw std::runtime_error("commands do not exist");
+  }
+  if (bulk->output().empty()) 
+    return print(rendered(bulk));
+  auto lock = interval_timer.lock();
+  auto text = bulk->output();
+  auto length = text.size() - 1;
+
+  if (!log.is_open() || (offset > 0 && offset + length + 1 > max_size) 
+      || (max_age > 0 && bulk->time - opened >= max_age)) {
+    rotate(bulk->time);
+  }
+
+  if (bulk->spill) {
+    // a spilled block goes from its mapping straight to the log, behind what is buffered
+    writeBuffers();
+    auto& metrics = Metrics::local();
+    LatencyTimer timer(metrics.write_latency);
+    log.write(text.data(), text.size());
+    metrics.bytes.add(text.size());
+  } else {
+    buffer += text;
+  }
+  index_buffer += std::to_string(bulk->id) + " " + std::to_string(bulk->time) + " " 
+    + std::to_string(offset) + " " + std::to_string(length) + "\n";
+  offset += length + 1;
+  pending++;
+  if (bulk->spill || policy.due(pending, last_flush) || durability.mode == Durability::PerBulk) 
+    writeBuffers();
+}
+
+void SegmentWriter::flush() {
+  auto lock = interval_timer.lock();
+  writeBuffers();
+  sync();
+}
+
+void SegmentWriter::writeBuffers() {
+  if (!buffer.empty() || !index_buffer.empty()) {
+    auto& metrics = Metrics::local();
+    LatencyTimer timer(metrics.write_latency);
+    metrics.bytes.add(buffer.size() + index_buffer.size());
+    log.write(buffer.data(), buffer.size());
+    log.flush();
+    index.write(index_buffer.data(), index_buffer.size());
+    index.flush();
+    buffer.clear();
+    index_buffer.clear();
+  }
+  unsynced += pending;
+  pending = 0;
+  last_flush = std::chrono::steady_clock::now();
+  if (durability.mode == Durability::PerBulk || 
+      (durability.mode == Durability::Group && unsynced && durability.group.due(unsynced, last_sync))) 
+    sync();
+}
+
+void SegmentWriter::sync() {
+  if (!unsynced || durability.mode == Durability::None) 
+    return;
+  sync_path(name);
+  sync_path(getIndexName());
+  if (created) 
+    sync_directory();
+  created = false;
+  unsynced = 0;
+  last_sync = std::chrono::steady_clock::now();
+}
+
+std::string SegmentWriter::getName() {
+  return name;
+}
+
+std::string SegmentWriter::getIndexName() {
+  return name.substr(0, name.size() - 4) + ".idx";
+}
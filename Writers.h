@@ -4,30 +4,152 @@
 #include <sstream>
 #include <fstream>
 #include <ctime>
+#include <memory>
 
 #include "Observer.h"
+#include "FlushPolicy.h"
+#include "Durability.h"
+#include "Compressor.h"
+#include "IntervalTimer.h"
 
 class ConsoleWriter : public Observer {
   std::ostream* out;
+  FlushPolicy policy;
+  std::string buffer;
+  std::size_t pending = 0;
+  std::chrono::steady_clock::time_point last_flush = std::chrono::steady_clock::now();
+  // flushes a <T>ms policy's buffer while no bulk arrives
+  IntervalTimer interval_timer;
+
+  void writeBuffer();
 public:
   ConsoleWriter();
   ConsoleWriter(std::ostream& out_stream);
-  void print() override;
+  ConsoleWriter(std::ostream& out_stream, const FlushPolicy& policy_);
+  ~ConsoleWriter();
+  void print(const BulkPtr& bulk) override;
+  void flush() override;
 };
 
+class Uring;
+
 //---------------------------------------------------------------------------------
 
+// Writes each bulk to its own bulk_<time>_<clock>_<pid>_<writer>.log file, where clock
+// is a strictly increasing monotonic nanosecond stamp and writer is unique in the process,
+// so many writers and processes can share a directory. Files are created with O_EXCL.
+// The Uring backend creates and writes a whole flush in io_uring batches, it falls back
+// to plain blocking calls when the kernel does not allow io_uring. PerBulk durability
+// fsyncs every file, Group durability fsyncs the files since the last commit and their directory
+// together, one directory fsync per group instead of one per file. A <T>ms flush policy
+// and a group:<T>ms group are applied by a timer once T has passed, even while no bulk arrives.
+// With a codec every file is one compressed frame, packed when the files are written,
+// off the Handler thread.
 class FileWriter : public Observer {
-  std::ofstream file;
-  std::time_t time;
+public:
+  enum class Backend {
+    Blocking,
+    Uring
+  };
+private:
+  std::time_t time = 0;
   std::string name;
-  int section = 0;
+  std::size_t bytes = 0;
+  std::size_t writer;
+  std::chrono::steady_clock::rep clock = 0;
+  FlushPolicy policy;
+  // pending files copy the rendered text, so a batching policy does not hold bulks back from the pool
+  struct File {
+    std::string name;
+    std::string content;
+    std::time_t time;
+    bool compressed = false;
+    // a spilled bulk is written from its mapping, content stays empty until compressed
+    std::shared_ptr<Spill> spill;
+
+    std::string_view data() const { 
+      if (!spill) 
+        return content;
+      auto text = spill->view();
+      return text.substr(0, text.size() - 1);
+    }
+  };
+  std::vector<File> files;
+  std::chrono::steady_clock::time_point last_flush = std::chrono::steady_clock::now();
+  std::unique_ptr<Uring> uring;
+  Durability durability;
+  // files of the current group, fsynced together by sync()
+  std::vector<std::string> unsynced;
+  std::chrono::steady_clock::time_point last_sync = std::chrono::steady_clock::now();
+  std::unique_ptr<Compressor> compressor;
+  IntervalTimer interval_timer;
+
+  std::string makeName(std::time_t time_);
+  void write(File& file);
+  // writes the pending files, commits the group only once it is due
+  void writeFiles();
+  void written(const File& file);
+  void flushUring();
+  // commits the group of files written since the last commit
+  void sync();
 public:
   FileWriter();
-  void update(const std::weak_ptr<Commands>& commands) override;
-  void print() override;
+  FileWriter(const FlushPolicy& policy_, Backend backend = Backend::Blocking, 
+    const Durability& durability_ = Durability(), Compressor::Codec codec = Compressor::None);
+  ~FileWriter();
+  void print(const BulkPtr& bulk) override;
+  // writes the pending files and commits whatever is not yet
+  void flush() override;
   std::string getName();
   std::time_t getTime();
+  std::size_t getBytes();
+  Backend getBackend() const { return uring ? Backend::Uring : Backend::Blocking; }
+};
+
+//---------------------------------------------------------------------------------
+
+// Appends every bulk to one segment file instead of creating a file per bulk.
+// A new segment starts once the current one reaches max_size bytes or max_age seconds.
+// Next to each segment an index keeps "<id> <time> <offset> <length>" per bulk.
+// Segments are named like bulk files, bulk_segment_<time>_<clock>_<pid>_<segment>.log,
+// and created with O_EXCL, so processes sharing a directory never append to the same one.
+// Durability syncs the segment and its index after every bulk or once per group,
+// <T>ms flush policies and group:<T>ms groups run on a timer like in FileWriter.
+class SegmentWriter : public Observer {
+  std::ofstream log;
+  std::ofstream index;
+  std::string name;
+  std::size_t max_size;
+  std::time_t max_age;
+  std::time_t opened = 0;
+  std::size_t segment = 0;
+  std::size_t offset = 0;
+  std::chrono::steady_clock::rep clock = 0;
+  FlushPolicy policy;
+  std::string buffer;
+  std::string index_buffer;
+  std::size_t pending = 0;
+  std::chrono::steady_clock::time_point last_flush = std::chrono::steady_clock::now();
+  Durability durability;
+  std::size_t unsynced = 0;
+  bool created = false;
+  std::chrono::steady_clock::time_point last_sync = std::chrono::steady_clock::now();
+  IntervalTimer interval_timer;
+
+  void rotate(std::time_t time);
+  // writes the buffers, commits the group only once it is due
+  void writeBuffers();
+  // syncs the bulks written to the segment since the last sync
+  void sync();
+public:
+  SegmentWriter(std::size_t max_size_, std::time_t max_age_ = 0, const FlushPolicy& policy_ = FlushPolicy(),
+    const Durability& durability_ = Durability());
+  ~SegmentWriter();
+  void print(const BulkPtr& bulk) override;
+  // writes the buffers and syncs whatever is not yet
+  void flush() override;
+  std::string getName();
+  std::string getIndexName();
 };
 
-#endif
\ No newline at end of file
+#endif
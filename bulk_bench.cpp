@@ -0,0 +1,447 @@
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "Handler.h"
+#include "BasicHandler.h"
+#include "Observer.h"
+#include "Writers.h"
+#include "Compressor.h"
+#include "AsyncWriter.h"
+#include "Queue.h"
+#include "RingQueue.h"
+
+#include <thread>
+#include <random>
+#include <algorithm>
+#include <filesystem>
+#include <unistd.h>
+
+// counted from every thread, the queue and end to end benchmarks allocate concurrently
+static std::atomic<std::size_t> allocations{0};
+
+void* operator new(std::size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (auto ptr = std::malloc(size ? size : 1))
+    return ptr;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+  std::free(ptr);
+}
+
+class NullWriter : public Observer {
+public:
+  void print(const BulkPtr& bulk) override {
+    benchmark::DoNotOptimize(bulk.get());
+  }
+};
+
+// Same as NullWriter, but final so BasicHandler calls it without any indirection.
+class StaticNullWriter final {
+public:
+  void print(const BulkPtr& bulk) {
+    benchmark::DoNotOptimize(bulk.get());
+  }
+  void flush() {}
+};
+
+static std::vector<std::string> make_lines(std::size_t count) {
+  std::vector<std::string> lines;
+  lines.reserve(count);
+  for (std::size_t i = 0; i < count; i++) {
+    lines.push_back("command_with_arguments_" + std::to_string(i));
+  }
+  return lines;
+}
+
+// Synthetic stream: numbered commands, with block_percent of them opening a { } block
+// of 1-16 commands nested depth levels deep.
+static std::vector<std::string> make_stream(std::size_t count, int block_percent, int depth = 1) {
+  std::mt19937 random(42);
+  std::uniform_int_distribution<int> percent(0, 99), block_size(1, 16);
+  std::vector<std::string> lines;
+  lines.reserve(count);
+  std::size_t command = 0;
+  while (command < count) {
+    if (percent(random) < block_percent) {
+      auto size = block_size(random);
+      for (int i = 0; i < depth; i++) 
+        lines.push_back("{");
+      for (int i = 0; i < size; i++) 
+        lines.push_back("cmd" + std::to_string(command++));
+      for (int i = 0; i < depth; i++) 
+        lines.push_back("}");
+    } else {
+      lines.push_back("cmd" + std::to_string(command++));
+    }
+  }
+  return lines;
+}
+
+// Runs the benchmark inside a scratch directory so FileWriter output is cleaned up.
+class ScratchDirectory {
+  std::filesystem::path previous;
+  std::filesystem::path path;
+public:
+  ScratchDirectory() : previous(std::filesystem::current_path()) {
+    path = std::filesystem::temp_directory_path() / ("bulk_bench_" + std::to_string(getpid()));
+    std::filesystem::create_directories(path);
+    std::filesystem::current_path(path);
+  }
+  ~ScratchDirectory() {
+    std::filesystem::current_path(previous);
+    std::filesystem::remove_all(path);
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void BM_AddCommand(benchmark::State& state) {
+  const auto lines = make_lines(1 << 16);
+  auto handler = std::make_shared<Handler>(state.range(0));
+  auto writer = std::make_shared<NullWriter>();
+  writer->subscribe(handler);
+
+  std::size_t i = 0;
+  auto start = allocations.load(std::memory_order_relaxed);
+  for (auto _ : state) {
+    handler->addCommand(lines[i++ & (lines.size() - 1)]);
+  }
+  state.counters["allocs_per_cmd"] = benchmark::Counter(
+    double(allocations.load(std::memory_order_relaxed) - start) / state.iterations());
+  state.SetItemsProcessed(state.iterations());
+  handler->stop();
+}
+BENCHMARK(BM_AddCommand)->Arg(1)->Arg(3)->Arg(16)->Arg(128)->Iterations(4 << 20);
+
+// Same lines through addCommands() in batches of 1024 as main() reads them, per command.
+static void BM_AddCommands(benchmark::State& state) {
+  const auto lines = make_lines(1 << 16);
+  const std::vector<std::string_view> views(lines.begin(), lines.end());
+  const std::size_t batch = 1024;
+  auto handler = std::make_shared<Handler>(state.range(0));
+  auto writer = std::make_shared<NullWriter>();
+  writer->subscribe(handler);
+
+  std::size_t i = 0;
+  for (auto _ : state) {
+    handler->addCommands(views.data() + i, nullptr, batch);
+    i = (i + batch) & (views.size() - 1);
+  }
+  state.SetItemsProcessed(state.iterations() * batch);
+  handler->stop();
+}
+BENCHMARK(BM_AddCommands)->Arg(1)->Arg(3)->Arg(16)->Arg(128)->Iterations(4 << 10);
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Per command cost of the runtime Observer path against the compile-time writer set,
+// both with three writers, the console and two files of the real program.
+static void BM_DynamicWriters(benchmark::State& state) {
+  const auto lines = make_lines(1 << 16);
+  auto handler = std::make_shared<Handler>(state.range(0));
+  std::vector<std::shared_ptr<NullWriter>> writers(3);
+  for (auto& writer : writers) {
+    writer = std::make_shared<NullWriter>();
+    writer->subscribe(handler);
+  }
+
+  std::size_t i = 0;
+  for (auto _ : state) {
+    handler->addCommand(lines[i++ & (lines.size() - 1)]);
+  }
+  state.SetItemsProcessed(state.iterations());
+  handler->stop();
+}
+BENCHMARK(BM_DynamicWriters)->Arg(1)->Arg(3)->Arg(16)->Iterations(4 << 20);
+
+static void BM_StaticWriters(benchmark::State& state) {
+  const auto lines = make_lines(1 << 16);
+  BasicHandler<StaticNullWriter, StaticNullWriter, StaticNullWriter> handler(state.range(0),
+    std::make_shared<StaticNullWriter>(), std::make_shared<StaticNullWriter>(), std::make_shared<StaticNullWriter>());
+
+  std::size_t i = 0;
+  for (auto _ : state) {
+    handler.addCommand(lines[i++ & (lines.size() - 1)]);
+  }
+  state.SetItemsProcessed(state.iterations());
+  handler.stop();
+}
+BENCHMARK(BM_StaticWriters)->Arg(1)->Arg(3)->Arg(16)->Iterations(4 << 20);
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void BM_BlockParser(benchmark::State& state) {
+  const auto lines = make_stream(1 << 16, state.range(0));
+  for (auto _ : state) {
+    BlockParser parser;
+    for (auto& line : lines) 
+      benchmark::DoNotOptimize(parser.parsing(line));
+  }
+  state.SetItemsProcessed(state.iterations() * lines.size());
+}
+BENCHMARK(BM_BlockParser)->Arg(0)->Arg(10)->Arg(50);
+
+// Splitting and parsing a 4 MiB buffer, arg 0: memchr per line and string compares as
+// LineReader::next() and addCommand() do it, arg 1: the same through the classifier kinds
+// produced by classify_lines(), arg 2: classify_lines_scalar() for the fallback.
+static void BM_SplitLines(benchmark::State& state) {
+  std::string buffer;
+  for (auto& line : make_stream(1 << 19, 20)) 
+    buffer += line + "\n";
+  std::vector<std::string_view> lines;
+  std::vector<LineKind> kinds;
+  lines.reserve(1024);
+  kinds.reserve(1024);
+  for (auto _ : state) {
+    BlockParser parser;
+    std::size_t begin = 0;
+    if (state.range(0) == 0) {
+      const char* found;
+      while ((found = static_cast<const char*>(std::memchr(buffer.data() + begin, '\n', buffer.size() - begin)))) {
+        std::string_view line(buffer.data() + begin, found - (buffer.data() + begin));
+        benchmark::DoNotOptimize(parser.parsing(line));
+        begin += line.size() + 1;
+      }
+      continue;
+    }
+    while (begin < buffer.size()) {
+      lines.clear();
+      kinds.clear();
+      begin += state.range(0) == 1 
+        ? classify_lines(buffer.data() + begin, buffer.size() - begin, lines, kinds, 1024)
+        : classify_lines_scalar(buffer.data() + begin, buffer.size() - begin, lines, kinds, 1024);
+      for (auto kind : kinds) 
+        benchmark::DoNotOptimize(parser.parsing(kind));
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(BM_SplitLines)->Arg(0)->Arg(1)->Arg(2);
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+// whole stream through Handler, args: N, percent of commands in blocks, nesting depth
+static void BM_AddCommandBlocks(benchmark::State& state) {
+  const auto lines = make_stream(1 << 16, state.range(1), state.range(2));
+  auto writer = std::make_shared<NullWriter>();
+  for (auto _ : state) {
+    auto handler = std::make_shared<Handler>(state.range(0));
+    writer->subscribe(handler);
+    for (auto& line : lines) 
+      handler->addCommand(line);
+    handler->stop();
+  }
+  state.SetItemsProcessed(state.iterations() * lines.size());
+}
+BENCHMARK(BM_AddCommandBlocks)->ArgsProduct({{1, 16, 128}, {10, 50}, {1, 4}});
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BulkPtr make_bulk(std::size_t size) {
+  auto bulk = std::make_shared<Bulk>();
+  for (auto& line : make_lines(size)) 
+    bulk->commands.push_back(line);
+  bulk->time = std::time(nullptr);
+  bulk->render();
+  return bulk;
+}
+
+static void BM_ConsoleWriter(benchmark::State& state) {
+  auto bulk = make_bulk(state.range(0));
+  std::stringbuf out_buffer;
+  std::ostream out_stream(&out_buffer);
+  ConsoleWriter writer(out_stream);
+  for (auto _ : state) {
+    writer.print(bulk);
+    out_buffer.str("");
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ConsoleWriter)->Arg(1)->Arg(16)->Arg(128);
+
+static void BM_FileWriter(benchmark::State& state) {
+  ScratchDirectory directory;
+  auto bulk = make_bulk(state.range(0));
+  FileWriter writer;
+  for (auto _ : state) {
+    writer.print(bulk);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(writer.getBytes());
+}
+BENCHMARK(BM_FileWriter)->Arg(1)->Arg(16)->Arg(128)->Iterations(20000);
+
+// Files per second of the blocking and io_uring backends, flushing every bulk or every 64 bulks.
+static void BM_FileBackend(benchmark::State& state) {
+  ScratchDirectory directory;
+  auto bulk = make_bulk(16);
+  FlushPolicy policy;
+  policy.mode = FlushPolicy::EveryBulks;
+  policy.bulks = state.range(1);
+  auto backend = state.range(0) ? FileWriter::Backend::Uring : FileWriter::Backend::Blocking;
+  FileWriter writer(policy, backend);
+  if (writer.getBackend() != backend) {
+    state.SkipWithError("io_uring is not available");
+    return;
+  }
+  for (auto _ : state) {
+    writer.print(bulk);
+  }
+  writer.flush();
+  state.SetLabel(state.range(0) ? "io_uring" : "blocking");
+  state.counters["files_per_second"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_FileBackend)->ArgsProduct({{0, 1}, {1, 64}})->Iterations(20000)->UseRealTime();
+
+// CPU per bulk with the console and file writers of main.cpp subscribed, from a closed bulk
+// to both writers holding its text. Console output goes to a stream without a buffer
+// and files are written after the loop, so only the per bulk work is timed.
+static void BM_PrintBulk(benchmark::State& state) {
+  ScratchDirectory directory;
+  auto bulk = std::make_shared<Bulk>(*make_bulk(state.range(0)));
+  std::ostream null_stream(nullptr);
+  ConsoleWriter consoleWriter(null_stream, FlushPolicy{FlushPolicy::PerBulk});
+  FileWriter fileWriter(FlushPolicy{FlushPolicy::OnStop});
+
+  for (auto _ : state) {
+    bulk->render();
+    consoleWriter.print(bulk);
+    fileWriter.print(bulk);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PrintBulk)->Arg(1)->Arg(16)->Arg(128)->Iterations(8192);
+
+// Compression ratio and input MB/s of one frame per bulk file, as FileWriter packs them.
+static void BM_Compress(benchmark::State& state) {
+  auto codec = static_cast<Compressor::Codec>(state.range(0));
+  if (!Compressor::available(codec)) {
+    state.SkipWithError("codec is not built in");
+    return;
+  }
+  auto bulk = make_bulk(state.range(1));
+  Compressor compressor(codec);
+  std::string frame;
+  for (auto _ : state) {
+    frame.clear();
+    compressor.compress(bulk->body(), frame);
+    benchmark::DoNotOptimize(frame.data());
+  }
+  state.SetBytesProcessed(state.iterations() * bulk->body().size());
+  state.counters["ratio"] = double(bulk->body().size()) / frame.size();
+}
+BENCHMARK(BM_Compress)->ArgsProduct({{Compressor::Gzip}, {16, 128, 1024}});
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Records how long each command waited between addCommand() and its bulk being printed.
+class LatencyWriter : public Observer {
+  const std::vector<std::chrono::steady_clock::time_point>& arrivals;
+public:
+  std::vector<double> latencies;
+  std::size_t bulks = 0;
+
+  LatencyWriter(const std::vector<std::chrono::steady_clock::time_point>& arrivals_) : arrivals(arrivals_) {}
+
+  void print(const BulkPtr& bulk) override {
+    auto now = std::chrono::steady_clock::now();
+    for (auto command : bulk->commands) {
+      auto index = std::stoul(std::string(command.substr(3)));
+      latencies.push_back(std::chrono::duration<double, std::micro>(now - arrivals[index]).count());
+    }
+    bulks++;
+  }
+};
+
+// End to end: synthetic stream -> Handler -> console and file writer threads.
+// args: N, percent of commands in blocks
+static void BM_EndToEnd(benchmark::State& state) {
+  ScratchDirectory directory;
+  const auto lines = make_stream(1 << 14, state.range(1));
+  std::vector<std::chrono::steady_clock::time_point> arrivals(lines.size());
+  std::vector<double> latencies;
+  std::size_t bulks = 0;
+  std::stringbuf out_buffer;
+  std::ostream out_stream(&out_buffer);
+
+  for (auto _ : state) {
+    auto handler = std::make_shared<Handler>(state.range(0));
+    auto latency = std::make_shared<LatencyWriter>(arrivals);
+    auto console = std::make_shared<AsyncWriter>(
+      std::vector<std::shared_ptr<Observer>>{std::make_shared<ConsoleWriter>(out_stream)});
+    auto measure = std::make_shared<AsyncWriter>(std::vector<std::shared_ptr<Observer>>{latency});
+    auto files = std::make_shared<AsyncWriter>(
+      std::vector<std::shared_ptr<Observer>>{std::make_shared<FileWriter>(), std::make_shared<FileWriter>()});
+    console->subscribe(handler);
+    files->subscribe(handler);
+    measure->subscribe(handler);
+    std::size_t command = 0;
+    for (auto& line : lines) {
+      if (line != "{" && line != "}") 
+        arrivals[command++] = std::chrono::steady_clock::now();
+      handler->addCommand(line);
+    }
+    handler->stop();
+    latencies.insert(latencies.end(), latency->latencies.begin(), latency->latencies.end());
+    bulks += latency->bulks;
+    out_buffer.str("");
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double p) { 
+    return latencies.empty() ? 0.0 : latencies[std::size_t(p * (latencies.size() - 1))]; 
+  };
+  state.counters["lines/s"] = benchmark::Counter(double(state.iterations() * lines.size()), benchmark::Counter::kIsRate);
+  state.counters["bulks/s"] = benchmark::Counter(double(bulks), benchmark::Counter::kIsRate);
+  state.counters["p50_us"] = percentile(0.5);
+  state.counters["p99_us"] = percentile(0.99);
+}
+BENCHMARK(BM_EndToEnd)->ArgsProduct({{1, 16, 128}, {0, 20}})->UseRealTime()->Unit(benchmark::kMillisecond);
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct MpscQueue : RingQueue<BulkPtr> {
+  MpscQueue(std::size_t capacity) : RingQueue<BulkPtr>(capacity, false) {}
+};
+
+// P producer threads hand 64K bulks to one consumer, time per bulk over the whole run
+template<typename Queue>
+static void BM_Queue(benchmark::State& state) {
+  const std::size_t producers = state.range(0);
+  const std::size_t items = 1 << 16;
+  auto bulk = std::make_shared<const Bulk>();
+  for (auto _ : state) {
+    Queue queue(1024);
+    std::thread consumer([&] {
+      BulkPtr item;
+      for (std::size_t i = 0; i < items; i++) 
+        queue.pop(item);
+    });
+    std::vector<std::thread> threads;
+    for (std::size_t p = 0; p < producers; p++) {
+      threads.emplace_back([&, p] {
+        for (std::size_t i = p; i < items; i += producers) 
+          queue.push(bulk);
+      });
+    }
+    for (auto& thread : threads) 
+      thread.join();
+    consumer.join();
+  }
+  state.SetItemsProcessed(state.iterations() * items);
+}
+BENCHMARK_TEMPLATE(BM_Queue, BlockingQueue<BulkPtr>)->RangeMultiplier(2)->Range(1, 16)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Queue, RingQueue<BulkPtr>)->RangeMultiplier(2)->Range(1, 16)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Queue, MpscQueue)->RangeMultiplier(2)->Range(1, 16)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,37 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "Compressor.h"
+
+// Prints bulk files, compressed or not, for inspection: bulk_cat <file>...
+// Without arguments it reads standard input.
+static void print(std::istream& in, const std::string& name) {
+  if (!in) {
+    throw std::runtime_error("can not read " + name);
+  }
+  std::stringstream content;
+  content << in.rdbuf();
+  std::string text;
+  Compressor::decompress(content.str(), text);
+  std::cout << text;
+  if (!text.empty() && text.back() != '\n')
+    std::cout << '\n';
+}
+
+int main(int argc, char *argv[])
+{
+  try {
+    if (argc < 2) {
+      print(std::cin, "standard input");
+    }
+    for (int i = 1; i < argc; i++) {
+      std::ifstream file(argv[i], std::ios::binary);
+      print(file, argv[i]);
+    }
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
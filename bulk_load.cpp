@@ -0,0 +1,95 @@
+#include <iostream>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+namespace asio = boost::asio;
+
+// Load generator for bulk_server:
+//   bulk_load <port|unix:path> <connections> <lines per connection> [block percent]
+// Opens all connections at once and streams the lines over each of them. A connection
+// completes when the server closes it after taking all of its lines, so the rate covers
+// the server's processing, not just the socket buffers.
+
+static std::string make_payload(std::size_t lines, int block_percent) {
+  std::string payload;
+  std::size_t command = 0;
+  while (command < lines) {
+    auto block = block_percent > 0 && command % 100 < std::size_t(block_percent) && command % 8 == 0;
+    if (block)
+      payload += "{\n";
+    for (auto i = 0; i < (block ? 8 : 1) && command < lines; i++)
+      payload += "cmd" + std::to_string(command++) + "\n";
+    if (block)
+      payload += "}\n";
+  }
+  return payload;
+}
+
+template<typename Protocol>
+static void start(asio::io_context& io, const typename Protocol::endpoint& endpoint, const std::string& payload,
+    std::size_t& completed, std::size_t& failed) {
+  auto socket = std::make_shared<typename Protocol::socket>(io);
+  socket->async_connect(endpoint, [socket, &payload, &completed, &failed](const boost::system::error_code& error) {
+    if (error) {
+      failed++;
+      return;
+    }
+    asio::async_write(*socket, asio::buffer(payload), [socket, &completed, &failed](const boost::system::error_code& error, std::size_t) {
+      if (error) {
+        failed++;
+        return;
+      }
+      boost::system::error_code ignored;
+      socket->shutdown(asio::socket_base::shutdown_send, ignored);
+      auto buffer = std::make_shared<char>();
+      socket->async_read_some(asio::buffer(buffer.get(), 1), [socket, buffer, &completed, &failed](const boost::system::error_code& error, std::size_t) {
+        if (error == asio::error::eof)
+          completed++;
+        else
+          failed++;
+      });
+    });
+  });
+}
+
+int main(int argc, char *argv[])
+{
+  try {
+    if (argc < 4) {
+      throw std::runtime_error("usage: bulk_load <port|unix:path> <connections> <lines per connection> [block percent]");
+    }
+    std::string address(argv[1]);
+    std::size_t connections = std::stoul(argv[2]);
+    std::size_t lines = std::stoul(argv[3]);
+    int block_percent = argc > 4 ? std::stoi(argv[4]) : 0;
+    auto payload = make_payload(lines, block_percent);
+
+    asio::io_context io;
+    std::size_t completed = 0, failed = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < connections; i++) {
+      if (address.compare(0, 5, "unix:") == 0) {
+        start<asio::local::stream_protocol>(io, asio::local::stream_protocol::endpoint(address.substr(5)),
+          payload, completed, failed);
+      } else {
+        asio::ip::tcp::endpoint endpoint(asio::ip::address_v4::loopback(), std::stoi(address));
+        start<asio::ip::tcp>(io, endpoint, payload, completed, failed);
+      }
+    }
+    io.run();
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - begin;
+
+    std::cout << "connections: " << completed << " completed, " << failed << " failed" << std::endl;
+    std::cout << "lines: " << completed * lines << " in " << seconds.count() << " s, "
+      << std::size_t(completed * lines / seconds.count()) << " lines/s" << std::endl;
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
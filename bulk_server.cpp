@@ -0,0 +1,92 @@
+#include <iostream>
+#include <csignal>
+#include <thread>
+
+#include "Server.h"
+#include "Writers.h"
+#include "AsyncWriter.h"
+#include "FileWriterPool.h"
+#include "Metrics.h"
+#include "Tracer.h"
+#include "Parser.h"
+
+// bulk_server <port|unix:path> <N> [options of bulk]
+// Every connection is a command stream as bulk reads from stdin. Stops on SIGINT or SIGTERM.
+// Writers always run on their own threads here, so --file-threads only sizes the file pool.
+// The options tuning a single Handler are refused, every connection has its own.
+int main(int argc, char *argv[])
+{
+  try {
+    if (argc < 3) {
+      throw std::runtime_error("usage: bulk_server <port|unix:path> <N> [options]");
+    }
+    std::string address(argv[1]);
+    auto options = parse_options(argc - 1, argv + 1);
+    if (options.max_delay_ms > 0 || options.max_bulk > 0) {
+      throw std::runtime_error("--max-delay-ms, --min-bulk and --max-bulk are not supported by bulk_server");
+    }
+    Metrics::setThreadName("server");
+    std::unique_ptr<MetricsExporter> exporter;
+    if (!options.metrics_file.empty()) {
+      exporter = std::make_unique<MetricsExporter>(options.metrics_file, std::chrono::milliseconds(options.metrics_interval));
+    }
+    if (!options.trace_file.empty()) {
+      Tracer::instance().start();
+    }
+
+    auto backend = options.io_uring ? FileWriter::Backend::Uring : FileWriter::Backend::Blocking;
+    auto consoleWriter = std::make_shared<AsyncWriter>(
+      std::vector<std::shared_ptr<Observer>>{std::make_shared<ConsoleWriter>(std::cout, options.flush)},
+      options.queue_size, options.backpressure);
+    std::shared_ptr<Observer> fileWriter;
+    if (options.segment_size > 0) {
+      fileWriter = std::make_shared<AsyncWriter>(std::vector<std::shared_ptr<Observer>>{
+        std::make_shared<SegmentWriter>(options.segment_size, options.segment_age, options.flush, options.durability)},
+        options.queue_size, options.backpressure);
+    } else {
+      auto threads = options.file_threads > 0 ? options.file_threads : 2;
+      fileWriter = std::make_shared<FileWriterPool>(threads, options.flush, options.queue_size, options.backpressure, backend,
+        options.durability, options.compression);
+    }
+
+    {
+      BulkServer server({consoleWriter, fileWriter}, options.N);
+      server.setBlockMemory(options.block_memory);
+      if (address.compare(0, 5, "unix:") == 0) {
+        server.listen(address.substr(5));
+      } else {
+        auto port = std::atoi(address.c_str());
+        if (port <= 0 || port > 65535 || address != std::to_string(port)) {
+          throw std::runtime_error("Incorrect port " + address);
+        }
+        server.listen(static_cast<unsigned short>(port));
+      }
+
+      boost::asio::io_context signals_io;
+      boost::asio::signal_set signals(signals_io, SIGINT, SIGTERM);
+      signals.async_wait([&server](const boost::system::error_code&, int) { server.stop(); });
+      std::thread signals_thread([&signals_io] { signals_io.run(); });
+
+      server.run();
+      signals_io.stop();
+      signals_thread.join();
+      if (options.stats) {
+        std::cerr << "connections: " << server.getAccepted() << std::endl;
+      }
+    }
+    consoleWriter->flush();
+    fileWriter->flush();
+    if (options.stats) {
+      Metrics::instance().report(std::cerr);
+    }
+    if (!options.trace_file.empty()) {
+      Tracer::instance().stop();
+      Tracer::instance().writeFile(options.trace_file);
+    }
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -4,9 +4,38 @@
 #include <boost/mpl/assert.hpp>
 
 #include "Handler.h"
+#include "BasicHandler.h"
 #include "Writers.h"
+#include "AsyncWriter.h"
+#include "Reader.h"
+#include "Dispatcher.h"
+#include "Server.h"
+#include "RingQueue.h"
+#include "FileWriterPool.h"
+#include "Metrics.h"
+#include "Tracer.h"
+#include "Ingestor.h"
+
+#include <set>
+#include <filesystem>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+class RecordWriter : public Observer {
+public:
+    std::vector<BulkPtr> bulks;
+    void print(const BulkPtr& bulk) override {
+        bulks.push_back(bulk);
+    }
+};
 
-using Commands = std::vector<std::string>;
+BulkPtr make_bulk(const Commands& commands) {
+    auto bulk = std::make_shared<Bulk>();
+    bulk->commands = commands;
+    bulk->time = std::time(nullptr);
+    return bulk;
+}
 
 BOOST_AUTO_TEST_SUITE(test_parser)
 
@@ -64,9 +93,8 @@ BOOST_AUTO_TEST_SUITE(test_writers)
         std::stringbuf out_buffer;
         std::ostream out_stream(&out_buffer);
         ConsoleWriter writer(out_stream);
-        auto commands = std::make_shared<Commands>(Commands{"cmd1", "cmd2"});
-        BOOST_CHECK_NO_THROW(writer.update(commands));
-        BOOST_CHECK_NO_THROW(writer.print());
+        auto bulk = make_bulk(Commands{"cmd1", "cmd2"});
+        BOOST_CHECK_NO_THROW(writer.print(bulk));
         BOOST_CHECK_EQUAL(out_buffer.str(),"bulk: cmd1, cmd2\n");
     }
 
@@ -75,9 +103,8 @@ BOOST_AUTO_TEST_SUITE(test_writers)
     BOOST_AUTO_TEST_CASE(print_file)
     {
         FileWriter writer;
-        auto commands = std::make_shared<Commands>(Commands{"cmd1"});
-        BOOST_CHECK_NO_THROW(writer.update(commands));
-        BOOST_CHECK_NO_THROW(writer.print());
+        auto bulk = make_bulk(Commands{"cmd1"});
+        BOOST_CHECK_NO_THROW(writer.print(bulk));
         std::ifstream file{writer.getName()};
         std::stringstream string_stream;
         string_stream << file.rdbuf();
@@ -90,9 +117,8 @@ BOOST_AUTO_TEST_SUITE(test_writers)
     BOOST_AUTO_TEST_CASE(current_time)
     {
         FileWriter writer;
-        auto commands = std::make_shared<Commands>(Commands{"cmd1"});
-        writer.update(commands);
-        writer.print();
+        auto bulk = make_bulk(Commands{"cmd1"});
+        writer.print(bulk);
         std::remove(writer.getName().c_str());
         BOOST_CHECK_EQUAL(std::time(nullptr),writer.getTime());
     }
@@ -104,11 +130,8 @@ BOOST_AUTO_TEST_SUITE(test_writers)
         std::stringbuf out_buffer;
         std::ostream out_stream(&out_buffer);
         ConsoleWriter writer(out_stream);
-        {
-            auto commands = std::make_shared<Commands>(Commands{"cmd1", "cmd2"});
-            writer.update(commands);
-        }
-        BOOST_CHECK_THROW(writer.print(),std::exception);
+        BulkPtr bulk;
+        BOOST_CHECK_THROW(writer.print(bulk),std::exception);
     }
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -116,9 +139,350 @@ BOOST_AUTO_TEST_SUITE(test_writers)
     BOOST_AUTO_TEST_CASE(delete_commands_file)
     {
         FileWriter writer;
-        std::shared_ptr<Commands> commands;
-        BOOST_CHECK_THROW(writer.update(commands),std::exception);
-        BOOST_CHECK_THROW(writer.print(),std::exception);
+        BulkPtr bulk;
+        BOOST_CHECK_THROW(writer.print(bulk),std::exception);
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(flush_policy)
+    {
+        BOOST_CHECK_EQUAL(parse_flush_policy("bulk").mode,FlushPolicy::PerBulk);
+        BOOST_CHECK_EQUAL(parse_flush_policy("stop").mode,FlushPolicy::OnStop);
+        BOOST_CHECK_EQUAL(parse_flush_policy("16").mode,FlushPolicy::EveryBulks);
+        BOOST_CHECK_EQUAL(parse_flush_policy("16").bulks,16);
+        BOOST_CHECK_EQUAL(parse_flush_policy("250ms").mode,FlushPolicy::Interval);
+        BOOST_CHECK_EQUAL(parse_flush_policy("250ms").interval.count(),250);
+        BOOST_CHECK_THROW(parse_flush_policy("0"),std::exception);
+        BOOST_CHECK_THROW(parse_flush_policy("ms"),std::exception);
+        BOOST_CHECK_THROW(parse_flush_policy("often"),std::exception);
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(flush_every_bulks)
+    {
+        std::stringbuf out_buffer;
+        std::ostream out_stream(&out_buffer);
+        FlushPolicy policy;
+        policy.mode = FlushPolicy::EveryBulks;
+        policy.bulks = 2;
+        ConsoleWriter writer(out_stream, policy);
+        writer.print(make_bulk(Commands{"cmd1"}));
+        BOOST_CHECK(out_buffer.str().empty());
+        writer.print(make_bulk(Commands{"cmd2", "cmd3"}));
+        BOOST_CHECK_EQUAL(out_buffer.str(),"bulk: cmd1\nbulk: cmd2, cmd3\n");
+        writer.print(make_bulk(Commands{"cmd4"}));
+        writer.flush();
+        BOOST_CHECK_EQUAL(out_buffer.str(),"bulk: cmd1\nbulk: cmd2, cmd3\nbulk: cmd4\n");
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(flush_interval)
+    {
+        // the writers' timers flush once the interval has passed, no further bulk comes
+        std::stringbuf out_buffer;
+        std::ostream out_stream(&out_buffer);
+        auto policy = parse_flush_policy("100ms");
+        ConsoleWriter consoleWriter(out_stream, policy);
+        FileWriter fileWriter(policy);
+        consoleWriter.print(make_bulk(Commands{"cmd1"}));
+        fileWriter.print(make_bulk(Commands{"cmd1"}));
+        BOOST_CHECK(out_buffer.str().empty());
+        BOOST_CHECK(!std::filesystem::exists(fileWriter.getName()));
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(400));
+        BOOST_CHECK_EQUAL(out_buffer.str(),"bulk: cmd1\n");
+        BOOST_CHECK(std::filesystem::exists(fileWriter.getName()));
+        std::remove(fileWriter.getName().c_str());
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(flush_files_on_stop)
+    {
+        FlushPolicy policy;
+        policy.mode = FlushPolicy::OnStop;
+        auto handler = std::make_shared<Handler>(1);
+        auto fileWriter = std::make_shared<FileWriter>(policy);
+        fileWriter->subscribe(handler);
+
+        handler->addCommand("cmd1");
+        std::ifstream before{fileWriter->getName()};
+        BOOST_CHECK(!before.is_open());
+        handler->stop();
+
+        std::ifstream file{fileWriter->getName()};
+        std::stringstream string_stream;
+        string_stream << file.rdbuf();
+        file.close();
+        std::remove(fileWriter->getName().c_str());
+        BOOST_CHECK_EQUAL(string_stream.str(),"bulk: cmd1");
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(unique_names)
+    {
+        FileWriter first, second;
+        auto bulk = make_bulk(Commands{"cmd1"});
+        std::set<std::string> names;
+        for (int i = 0; i < 100; i++) {
+            first.print(bulk);
+            second.print(bulk);
+            names.insert(first.getName());
+            names.insert(second.getName());
+        }
+        for (auto& name : names) {
+            std::remove(name.c_str());
+        }
+        BOOST_CHECK_EQUAL(names.size(),200);
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(existing_file)
+    {
+        FlushPolicy policy;
+        policy.mode = FlushPolicy::OnStop;
+        FileWriter writer(policy);
+        writer.print(make_bulk(Commands{"cmd1"}));
+        auto taken = writer.getName();
+        std::ofstream(taken) << "other";
+        writer.flush();
+
+        std::ifstream file{writer.getName()};
+        std::stringstream string_stream;
+        string_stream << file.rdbuf();
+        file.close();
+        std::remove(writer.getName().c_str());
+        std::ifstream other{taken};
+        std::stringstream other_stream;
+        other_stream << other.rdbuf();
+        other.close();
+        std::remove(taken.c_str());
+
+        BOOST_CHECK(writer.getName() != taken);
+        BOOST_CHECK_EQUAL(string_stream.str(),"bulk: cmd1");
+        BOOST_CHECK_EQUAL(other_stream.str(),"other");
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(uring_files)
+    {
+        FlushPolicy policy;
+        policy.mode = FlushPolicy::OnStop;
+        FileWriter writer(policy, FileWriter::Backend::Uring);
+        std::vector<std::string> names;
+        for (auto i = 0; i < 70; i++) {
+            writer.print(make_bulk(Commands{"cmd" + std::to_string(i), "cmd"}));
+            names.push_back(writer.getName());
+        }
+        std::ofstream(names.back()) << "other";
+        writer.flush();
+        names.push_back(writer.getName());
+
+        std::multiset<std::string> contents;
+        for (auto& name : names) {
+            std::ifstream file{name};
+            std::stringstream string_stream;
+            string_stream << file.rdbuf();
+            contents.insert(string_stream.str());
+            std::remove(name.c_str());
+        }
+
+        BOOST_CHECK_EQUAL(contents.size(), 71);
+        BOOST_CHECK_EQUAL(contents.count("other"), 1);
+        BOOST_CHECK_EQUAL(contents.count("bulk: cmd0, cmd"), 1);
+        BOOST_CHECK_EQUAL(contents.count("bulk: cmd69, cmd"), 1);
+        BOOST_CHECK_EQUAL(writer.getBytes(), 10 * 15 + 60 * 16);
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(durability)
+    {
+        BOOST_CHECK_EQUAL(parse_durability("none").mode,Durability::None);
+        BOOST_CHECK_EQUAL(parse_durability("bulk").mode,Durability::PerBulk);
+        BOOST_CHECK_EQUAL(parse_durability("group:8").group.bulks,8);
+        BOOST_CHECK_EQUAL(parse_durability("group:5ms").group.interval.count(),5);
+        BOOST_CHECK_THROW(parse_durability("group:stop"),std::exception);
+        BOOST_CHECK_THROW(parse_durability("always"),std::exception);
+
+        auto& syncs = Metrics::local().sync_latency.count;
+        std::vector<std::string> names;
+        auto start = syncs.get();
+        {
+            FileWriter writer(FlushPolicy(), FileWriter::Backend::Blocking, parse_durability("bulk"));
+            for (auto i = 0; i < 2; i++) {
+                writer.print(make_bulk(Commands{"cmd1"}));
+                names.push_back(writer.getName());
+            }
+        }
+        // a file and its directory per bulk
+        BOOST_CHECK_EQUAL(syncs.get() - start, 4);
+
+        start = syncs.get();
+        {
+            FileWriter writer(FlushPolicy(), FileWriter::Backend::Blocking, parse_durability("group:3"));
+            for (auto i = 0; i < 5; i++) {
+                writer.print(make_bulk(Commands{"cmd1"}));
+                names.push_back(writer.getName());
+            }
+            // the three files of the group and their directory once
+            BOOST_CHECK_EQUAL(syncs.get() - start, 4);
+        }
+        BOOST_CHECK_EQUAL(syncs.get() - start, 7);
+        for (auto& name : names) 
+            std::remove(name.c_str());
+
+        start = syncs.get();
+        SegmentWriter segment(1024, 0, FlushPolicy(), parse_durability("group:2"));
+        for (auto i = 0; i < 4; i++) 
+            segment.print(make_bulk(Commands{"cmd1"}));
+        std::remove(segment.getName().c_str());
+        std::remove(segment.getIndexName().c_str());
+        // the first commit also syncs the directory of the new segment
+        BOOST_CHECK_EQUAL(syncs.get() - start, 5);
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(durability_tail)
+    {
+        auto& syncs = Metrics::local().sync_latency.count;
+        std::vector<std::string> names;
+        auto start = syncs.get();
+        {
+            auto handler = std::make_shared<Handler>(1);
+            auto fileWriter = std::make_shared<FileWriter>(FlushPolicy(), FileWriter::Backend::Blocking, 
+                parse_durability("group:10"));
+            auto segmentWriter = std::make_shared<SegmentWriter>(1024, 0, FlushPolicy(), parse_durability("group:10"));
+            fileWriter->subscribe(handler);
+            segmentWriter->subscribe(handler);
+            for (auto command : {"cmd1", "cmd2", "cmd3"}) {
+                handler->addCommand(command);
+                names.push_back(fileWriter->getName());
+            }
+            BOOST_CHECK_EQUAL(syncs.get() - start, 0);
+            handler->stop();
+            // the partial groups are committed by stop(), not left to the destructors:
+            // three files and their directory, the segment, its index and their directory
+            BOOST_CHECK_EQUAL(syncs.get() - start, 7);
+            names.push_back(segmentWriter->getName());
+            names.push_back(segmentWriter->getIndexName());
+        }
+        BOOST_CHECK_EQUAL(syncs.get() - start, 7);
+
+        // an idle group:<T>ms group is committed by the timer thread, nothing is left for flush()
+        start = syncs.get();
+        {
+            FileWriter writer(FlushPolicy(), FileWriter::Backend::Blocking, parse_durability("group:20ms"));
+            writer.print(make_bulk(Commands{"cmd1"}));
+            names.push_back(writer.getName());
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            writer.flush();
+            BOOST_CHECK_EQUAL(syncs.get() - start, 0);
+        }
+        for (auto& name : names) 
+            std::remove(name.c_str());
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(compressed_files)
+    {
+        for (auto codec : {Compressor::Gzip}) {
+            if (!Compressor::available(codec)) {
+                BOOST_CHECK_THROW(FileWriter(FlushPolicy(), FileWriter::Backend::Blocking, Durability(), codec), 
+                    std::exception);
+                continue;
+            }
+            std::string frames;
+            Compressor compressor(codec);
+            compressor.compress("bulk: cmd1", frames);
+            compressor.compress(", cmd2", frames);
+            std::string text;
+            Compressor::decompress(frames, text);
+            BOOST_CHECK_EQUAL(text, "bulk: cmd1, cmd2");
+
+            FileWriter writer(FlushPolicy(), FileWriter::Backend::Blocking, Durability(), codec);
+            writer.print(make_bulk(Commands{"cmd1", "cmd2"}));
+            std::ifstream file{writer.getName(), std::ios::binary};
+            std::stringstream string_stream;
+            string_stream << file.rdbuf();
+            file.close();
+            std::remove(writer.getName().c_str());
+            text.clear();
+            Compressor::decompress(string_stream.str(), text);
+
+            BOOST_CHECK(writer.getName().find(std::string(".log") + Compressor::extension(codec)) != std::string::npos);
+            BOOST_CHECK_EQUAL(text, "bulk: cmd1, cmd2");
+        }
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(append_segments)
+    {
+        SegmentWriter writer(28);
+        auto first = make_bulk(Commands{"cmd1", "cmd2"});
+        auto second = make_bulk(Commands{"cmd3"});
+        auto third = make_bulk(Commands{"cmd4"});
+        writer.print(first);
+        writer.print(second);
+        auto name = writer.getName();
+        auto index_name = writer.getIndexName();
+        writer.print(third);
+        writer.flush();
+
+        std::ifstream file{name};
+        std::stringstream string_stream;
+        string_stream << file.rdbuf();
+        file.close();
+        std::ifstream index{index_name};
+        std::stringstream index_stream;
+        index_stream << index.rdbuf();
+        index.close();
+        std::remove(name.c_str());
+        std::remove(index_name.c_str());
+        BOOST_CHECK(writer.getName() != name);
+        std::remove(writer.getName().c_str());
+        std::remove(writer.getIndexName().c_str());
+
+        auto time = std::to_string(first->time);
+        BOOST_CHECK_EQUAL(string_stream.str(),"bulk: cmd1, cmd2\nbulk: cmd3\n");
+        BOOST_CHECK_EQUAL(index_stream.str(),"0 " + time + " 0 16\n0 " + time + " 17 10\n");
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(separate_segments)
+    {
+        // two writers opening segments in the same second never share one
+        SegmentWriter first(1024), second(1024);
+        auto bulk = make_bulk(Commands{"cmd1"});
+        first.print(bulk);
+        second.print(bulk);
+        first.flush();
+        second.flush();
+        BOOST_CHECK(first.getName() != second.getName());
+        for (auto writer : {&first, &second}) {
+            std::ifstream file{writer->getName()};
+            std::stringstream string_stream;
+            string_stream << file.rdbuf();
+            file.close();
+            std::ifstream index{writer->getIndexName()};
+            std::stringstream index_stream;
+            index_stream << index.rdbuf();
+            index.close();
+            std::remove(writer->getName().c_str());
+            std::remove(writer->getIndexName().c_str());
+            BOOST_CHECK_EQUAL(string_stream.str(),"bulk: cmd1\n");
+            BOOST_CHECK_EQUAL(index_stream.str(),"0 " + std::to_string(bulk->time) + " 0 10\n");
+        }
     }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -192,6 +556,345 @@ BOOST_AUTO_TEST_SUITE(test_handler)
         BOOST_CHECK_EQUAL(string_stream.str(),"bulk: cmd3, cmd4");
     }
 
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(commands_arena)
+    {
+        Commands commands{"cmd1", "", "cmd3"};
+        BOOST_REQUIRE_EQUAL(commands.size(),3);
+        BOOST_CHECK(commands[0] == "cmd1");
+        BOOST_CHECK(commands[1].empty());
+        BOOST_CHECK(commands[2] == "cmd3");
+        commands.clear();
+        BOOST_CHECK(commands.empty());
+        commands.push_back("cmd4");
+        BOOST_CHECK(commands == Commands({"cmd4"}));
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(recycle_bulks)
+    {
+        BulkPool pool;
+        auto bulk = pool.acquire();
+        bulk->commands.push_back("cmd1");
+        auto address = bulk.get();
+        BulkPtr kept = bulk;
+        bulk.reset();
+        BOOST_CHECK(pool.acquire().get() != address);
+        kept.reset();
+        bulk = pool.acquire();
+        BOOST_CHECK(bulk.get() == address);
+        BOOST_CHECK(bulk->commands.empty());
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(keep_snapshots)
+    {
+        auto handler = std::make_shared<Handler>(2);
+        auto recordWriter = std::make_shared<RecordWriter>();
+        recordWriter->subscribe(handler);
+
+        handler->addCommand("cmd1");
+        handler->addCommand("cmd2");
+        handler->addCommand("cmd3");
+        handler->addCommand("cmd4");
+        handler->addCommand("cmd5");
+        handler->stop();
+
+        BOOST_REQUIRE_EQUAL(recordWriter->bulks.size(),3);
+        BOOST_CHECK(recordWriter->bulks[0]->commands == Commands({"cmd1", "cmd2"}));
+        BOOST_CHECK(recordWriter->bulks[1]->commands == Commands({"cmd3", "cmd4"}));
+        BOOST_CHECK(recordWriter->bulks[2]->commands == Commands({"cmd5"}));
+        for (std::size_t i = 0; i < recordWriter->bulks.size(); i++) {
+            BOOST_CHECK_EQUAL(recordWriter->bulks[i]->id,i);
+            BOOST_CHECK(recordWriter->bulks[i]->time != 0);
+        }
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(render_once)
+    {
+        std::stringbuf out_buffer;
+        std::ostream out_stream(&out_buffer);
+        auto handler = std::make_shared<Handler>(2);
+        auto recordWriter = std::make_shared<RecordWriter>();
+        auto consoleWriter = std::make_shared<ConsoleWriter>(out_stream);
+        recordWriter->subscribe(handler);
+        consoleWriter->subscribe(handler);
+
+        handler->addCommand("cmd1");
+        handler->addCommand("cmd2");
+
+        BOOST_REQUIRE_EQUAL(recordWriter->bulks.size(), 1);
+        auto& bulk = recordWriter->bulks.front();
+        BOOST_CHECK_EQUAL(bulk->text, "bulk: cmd1, cmd2\n");
+        BOOST_CHECK_EQUAL(bulk->body(), "bulk: cmd1, cmd2");
+        BOOST_CHECK_EQUAL(out_buffer.str(), bulk->text);
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(max_delay)
+    {
+        std::stringbuf out_buffer;
+        std::ostream out_stream(&out_buffer);
+        auto handler = std::make_shared<Handler>(100);
+        auto consoleWriter = std::make_shared<ConsoleWriter>(out_stream);
+        consoleWriter->subscribe(handler);
+        handler->setMaxDelay(std::chrono::milliseconds(20));
+
+        handler->addCommand("cmd1");
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        handler->addCommand("cmd2");
+        handler->addCommand("{");
+        handler->addCommand("cmd3");
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        handler->addCommand("cmd4");
+        handler->addCommand("}");
+        handler->stop();
+
+        BOOST_CHECK_EQUAL(out_buffer.str(),"bulk: cmd1\nbulk: cmd2\nbulk: cmd3, cmd4\n");
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class FailingWriter : public Observer {
+    public:
+        void print(const BulkPtr&) override {
+            throw std::runtime_error("writer failed");
+        }
+    };
+
+    BOOST_AUTO_TEST_CASE(max_delay_error)
+    {
+        auto handler = std::make_shared<Handler>(100);
+        auto failingWriter = std::make_shared<FailingWriter>();
+        failingWriter->subscribe(handler);
+        handler->setMaxDelay(std::chrono::milliseconds(20));
+
+        handler->addCommand("cmd1");
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        // thrown on the timer thread, handed to the next call instead of terminating
+        BOOST_CHECK_THROW(handler->addCommand("cmd2"),std::runtime_error);
+        handler->addCommand("cmd3");
+        BOOST_CHECK_THROW(handler->stop(),std::runtime_error);
+
+        handler = std::make_shared<Handler>(100);
+        failingWriter->subscribe(handler);
+        handler->setMaxDelay(std::chrono::milliseconds(20));
+        handler->addCommand("cmd1");
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        BOOST_CHECK_THROW(handler->finish(),std::runtime_error);
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(size_after_block)
+    {
+        std::stringbuf out_buffer;
+        std::ostream out_stream(&out_buffer);
+        auto handler = std::make_shared<Handler>(3);
+        auto consoleWriter = std::make_shared<ConsoleWriter>(out_stream);
+        consoleWriter->subscribe(handler);
+
+        for (auto command : {"{", "cmd1", "}", "cmd2", "cmd3", "cmd4"}) 
+            handler->addCommand(command);
+        handler->stop();
+
+        BOOST_CHECK_EQUAL(out_buffer.str(),"bulk: cmd1\nbulk: cmd2, cmd3, cmd4\n");
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(adaptive_size)
+    {
+        std::stringbuf out_buffer;
+        std::ostream out_stream(&out_buffer);
+        auto handler = std::make_shared<Handler>(2);
+        auto recordWriter = std::make_shared<RecordWriter>();
+        recordWriter->subscribe(handler);
+        handler->setAdaptive(2, 8);
+
+        for (auto i = 0; i < 14; i++) 
+            handler->addCommand("cmd" + std::to_string(i));
+        handler->addCommand("{");
+        handler->addCommand("cmd14");
+        handler->addCommand("}");
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        for (auto i = 15; i < 23; i++) 
+            handler->addCommand("cmd" + std::to_string(i));
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        handler->addCommand("cmd23");
+        handler->addCommand("cmd24");
+        handler->addCommand("cmd25");
+        handler->setReport(out_stream);
+        handler->stop();
+
+        std::vector<std::size_t> sizes, expected{2, 4, 8, 1, 8, 3};
+        for (auto& bulk : recordWriter->bulks) 
+            sizes.push_back(bulk->commands.size());
+        BOOST_CHECK_EQUAL_COLLECTIONS(sizes.begin(), sizes.end(), expected.begin(), expected.end());
+        auto chosen = handler->chosenSizes();
+        BOOST_CHECK_EQUAL(chosen[2], 1);
+        BOOST_CHECK_EQUAL(chosen[8], 2);
+        BOOST_CHECK(out_buffer.str().find("bulk sizes: 2x1 4x1 8x2\n") != std::string::npos);
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(static_writers)
+    {
+        std::stringbuf out_buffer;
+        std::ostream out_stream(&out_buffer);
+        BasicHandler<ConsoleWriter, RecordWriter> handler(2, 
+            std::make_shared<ConsoleWriter>(out_stream), std::make_shared<RecordWriter>());
+
+        for (auto command : {"cmd1", "cmd2", "cmd3", "{", "cmd4", "{", "cmd5", "}", "}", "cmd6"}) 
+            handler.addCommand(command);
+        handler.stop();
+
+        BOOST_CHECK_EQUAL(out_buffer.str(),"bulk: cmd1, cmd2\nbulk: cmd3\nbulk: cmd4, cmd5\nbulk: cmd6\n");
+        BOOST_CHECK_EQUAL(handler.writer<1>().bulks.size(), 4);
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(static_writers_spill)
+    {
+        std::stringbuf out_buffer;
+        std::ostream out_stream(&out_buffer);
+        BasicHandler<ConsoleWriter, RecordWriter> handler(2, 
+            std::make_shared<ConsoleWriter>(out_stream), std::make_shared<RecordWriter>());
+        handler.setBlockMemory(8);
+
+        std::vector<std::string_view> lines{"cmd1", "{", "cmd2", "cmd3", "cmd4", "}", "cmd5", "cmd6", "{", "cmd7"};
+        handler.addCommands(lines);
+        BOOST_CHECK(handler.inBlock());
+        handler.stop();
+
+        BOOST_CHECK_EQUAL(out_buffer.str(),"bulk: cmd1\nbulk: cmd2, cmd3, cmd4\nbulk: cmd5, cmd6\n");
+        auto& bulks = handler.writer<1>().bulks;
+        BOOST_REQUIRE_EQUAL(bulks.size(), 3);
+        BOOST_CHECK(bulks[1]->spill);
+        BOOST_CHECK(!bulks[2]->spill);
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // counts the writer calls, a batch of bulks is one call
+    class BatchWriter : public RecordWriter {
+    public:
+        std::size_t calls = 0;
+        void print(const BulkPtr& bulk) override {
+            calls++;
+            RecordWriter::print(bulk);
+        }
+        void printBatch(const std::vector<BulkPtr>& batch) override {
+            calls++;
+            bulks.insert(bulks.end(), batch.begin(), batch.end());
+        }
+    };
+
+    BOOST_AUTO_TEST_CASE(add_commands)
+    {
+        std::stringbuf out_buffer;
+        std::ostream out_stream(&out_buffer);
+        auto handler = std::make_shared<Handler>(2);
+        auto consoleWriter = std::make_shared<ConsoleWriter>(out_stream);
+        auto batchWriter = std::make_shared<BatchWriter>();
+        consoleWriter->subscribe(handler);
+        batchWriter->subscribe(handler);
+
+        std::vector<std::string_view> lines{"cmd1", "cmd2", "cmd3", "{", "cmd4", "{", "cmd5", "}", "}", "cmd6"};
+        handler->addCommands(lines);
+        BOOST_CHECK_EQUAL(out_buffer.str(),"bulk: cmd1, cmd2\nbulk: cmd3\nbulk: cmd4, cmd5\n");
+        BOOST_CHECK_EQUAL(batchWriter->calls,1);
+        BOOST_CHECK_EQUAL(batchWriter->bulks.size(),3);
+
+        // bulks closed before a bad line still reach the writers
+        BOOST_CHECK_THROW(handler->addCommands({"cmd7", "{", "}", "cmd8"}), std::runtime_error);
+        BOOST_CHECK_EQUAL(out_buffer.str(),"bulk: cmd1, cmd2\nbulk: cmd3\nbulk: cmd4, cmd5\nbulk: cmd6, cmd7\n");
+        BOOST_CHECK_EQUAL(batchWriter->calls,2);
+
+        handler->addCommands(std::vector<std::string_view>());
+        handler->addCommand("cmd9");
+        handler->stop();
+        BOOST_CHECK_EQUAL(batchWriter->calls,3);
+        BOOST_CHECK_EQUAL(batchWriter->bulks.size(),5);
+        BOOST_CHECK_EQUAL(batchWriter->bulks[4]->body(),"bulk: cmd9");
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(spill_block)
+    {
+        std::stringbuf out_buffer;
+        std::ostream out_stream(&out_buffer);
+        auto handler = std::make_shared<Handler>(2);
+        auto consoleWriter = std::make_shared<ConsoleWriter>(out_stream);
+        auto fileWriter = std::make_shared<FileWriter>();
+        auto recordWriter = std::make_shared<RecordWriter>();
+        auto segmentWriter = std::make_shared<SegmentWriter>(1 << 20);
+        consoleWriter->subscribe(handler);
+        fileWriter->subscribe(handler);
+        recordWriter->subscribe(handler);
+        segmentWriter->subscribe(handler);
+        handler->setBlockMemory(12);
+
+        std::string expected("bulk: cmd0");
+        handler->addCommand("{");
+        auto opened = std::time(nullptr);
+        handler->addCommand("cmd0");
+        // the block spills a second later, commands after that must not restamp it
+        auto first_time = std::time(nullptr);
+        std::this_thread::sleep_until(std::chrono::system_clock::from_time_t(first_time + 1));
+        for (auto i = 1; i < 10; i++) {
+            handler->addCommand("cmd" + std::to_string(i));
+            expected += ", cmd" + std::to_string(i);
+        }
+        handler->addCommand("}");
+        auto spilled_file = fileWriter->getName();
+        handler->addCommand("cmd10");
+        handler->addCommand("cmd11");
+        auto read_file = [](const std::string& name) {
+            std::ifstream file{name};
+            std::stringstream string_stream;
+            string_stream << file.rdbuf();
+            file.close();
+            std::remove(name.c_str());
+            return string_stream.str();
+        };
+
+        BOOST_REQUIRE_EQUAL(recordWriter->bulks.size(),2);
+        auto& spilled = recordWriter->bulks[0];
+        BOOST_CHECK(spilled->spill);
+        BOOST_CHECK_EQUAL(spilled->spilled + spilled->commands.size(),10);
+        BOOST_CHECK(spilled->commands.bytes() <= 12);
+        BOOST_CHECK_EQUAL(spilled->body(),expected);
+        BOOST_CHECK(!recordWriter->bulks[1]->spill);
+        BOOST_CHECK(spilled->time >= opened && spilled->time <= first_time);
+        BOOST_CHECK_EQUAL(out_buffer.str(),expected + "\nbulk: cmd10, cmd11\n");
+
+        BOOST_CHECK_EQUAL(read_file(spilled_file),expected);
+        BOOST_CHECK_EQUAL(read_file(fileWriter->getName()),"bulk: cmd10, cmd11");
+
+        // a block still open at the end is dropped, spilled or not
+        handler->addCommand("{");
+        for (auto i = 12; i < 40; i++) 
+            handler->addCommand("cmd" + std::to_string(i));
+        handler->stop();
+        BOOST_CHECK_EQUAL(recordWriter->bulks.size(),2);
+        BOOST_CHECK_EQUAL(out_buffer.str(),expected + "\nbulk: cmd10, cmd11\n");
+
+        auto index = read_file(segmentWriter->getIndexName());
+        BOOST_CHECK_EQUAL(read_file(segmentWriter->getName()),expected + "\nbulk: cmd10, cmd11\n");
+        BOOST_CHECK(index.find(" 0 " + std::to_string(expected.size()) + "\n") != std::string::npos);
+        BOOST_CHECK(index.find(" " + std::to_string(expected.size() + 1) + " 18\n") != std::string::npos);
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -471,4 +1174,681 @@ BOOST_AUTO_TEST_SUITE(extendeds_tests)
         BOOST_CHECK_THROW(handler->addCommand("}"),std::exception);
     }
 
-BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
+BOOST_AUTO_TEST_SUITE_END()
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE(test_async)
+
+    BOOST_AUTO_TEST_CASE(async_console)
+    {
+        std::stringbuf out_buffer;
+        std::ostream out_stream(&out_buffer);
+
+        auto handler = std::make_shared<Handler>(2);
+        auto consoleWriter = std::make_shared<AsyncWriter>(
+            std::vector<std::shared_ptr<Observer>>{std::make_shared<ConsoleWriter>(out_stream)});
+        consoleWriter->subscribe(handler);
+
+        handler->addCommand("cmd1");
+        handler->addCommand("cmd2");
+        handler->addCommand("{");
+        handler->addCommand("cmd3");
+        handler->addCommand("}");
+        handler->addCommand("cmd4");
+        handler->stop();
+
+        BOOST_CHECK_EQUAL(out_buffer.str(),"bulk: cmd1, cmd2\nbulk: cmd3\nbulk: cmd4\n");
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(async_workers)
+    {
+        std::stringbuf first_buffer, second_buffer;
+        std::ostream first_stream(&first_buffer), second_stream(&second_buffer);
+
+        auto handler = std::make_shared<Handler>(1);
+        auto writer = std::make_shared<AsyncWriter>(std::vector<std::shared_ptr<Observer>>{
+            std::make_shared<ConsoleWriter>(first_stream), std::make_shared<ConsoleWriter>(second_stream)});
+        writer->subscribe(handler);
+
+        handler->addCommand("cmd1");
+        handler->addCommand("cmd2");
+        handler->stop();
+
+        auto content = first_buffer.str() + second_buffer.str();
+        BOOST_CHECK(content == "bulk: cmd1\nbulk: cmd2\n" || content == "bulk: cmd2\nbulk: cmd1\n");
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(file_pool)
+    {
+        FlushPolicy policy;
+        auto handler = std::make_shared<Handler>(2);
+        auto pool = std::make_shared<FileWriterPool>(3, policy, 4);
+        pool->subscribe(handler);
+
+        for (int i = 0; i < 40; i++) {
+            handler->addCommand("cmd" + std::to_string(i));
+        }
+        handler->stop();
+
+        std::size_t bulks = 0, commands = 0, bytes = 0;
+        for (auto& stats : pool->stats()) {
+            bulks += stats.bulks;
+            commands += stats.commands;
+            bytes += stats.bytes;
+        }
+        BOOST_CHECK_EQUAL(bulks,20);
+        BOOST_CHECK_EQUAL(commands,40);
+
+        std::multiset<std::string> contents;
+        std::size_t size = 0;
+        for (int i = 0; i < 20; i++) {
+            auto content = "bulk: cmd" + std::to_string(2 * i) + ", cmd" + std::to_string(2 * i + 1);
+            size += content.size();
+            contents.insert(content);
+        }
+        BOOST_CHECK_EQUAL(bytes,size);
+
+        std::multiset<std::string> written;
+        auto pid = "_" + std::to_string(getpid()) + "_";
+        for (auto& entry : std::filesystem::directory_iterator(".")) {
+            auto name = entry.path().filename().string();
+            if (name.compare(0, 5, "bulk_") != 0 || name.find(pid) == std::string::npos)
+                continue;
+            std::ifstream file{entry.path()};
+            std::stringstream string_stream;
+            string_stream << file.rdbuf();
+            file.close();
+            std::remove(entry.path().c_str());
+            written.insert(string_stream.str());
+        }
+        BOOST_CHECK(written == contents);
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(file_pool_backpressure)
+    {
+        auto read_written = [] {
+            std::set<std::string> written;
+            auto pid = "_" + std::to_string(getpid()) + "_";
+            for (auto& entry : std::filesystem::directory_iterator(".")) {
+                auto name = entry.path().filename().string();
+                if (name.compare(0, 5, "bulk_") != 0 || name.find(pid) == std::string::npos)
+                    continue;
+                std::ifstream file{entry.path()};
+                std::stringstream string_stream;
+                string_stream << file.rdbuf();
+                file.close();
+                std::remove(entry.path().c_str());
+                written.insert(string_stream.str());
+            }
+            return written;
+        };
+        std::vector<BulkPtr> bulks;
+        for (int i = 0; i < 50; i++) 
+            bulks.push_back(make_bulk(Commands{"cmd" + std::to_string(i)}));
+
+        // the batch is queued past the capacity without waiting
+        FileWriterPool spill(1, FlushPolicy(), 2, Backpressure::Spill);
+        spill.printBatch(bulks);
+        spill.flush();
+        BOOST_CHECK_EQUAL(spill.dropped(),0);
+        BOOST_CHECK_EQUAL(read_written().size(),50);
+
+        // whatever is dropped, the newest bulk is always written
+        FileWriterPool drop(1, FlushPolicy(), 2, Backpressure::DropOldest);
+        drop.printBatch(bulks);
+        drop.flush();
+        auto written = read_written();
+        BOOST_CHECK_EQUAL(written.size() + drop.dropped(),50);
+        BOOST_CHECK(written.count("bulk: cmd49"));
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE(test_reader)
+
+    std::vector<std::string> read_lines(int fd, std::size_t chunk) {
+        LineReader reader(fd, chunk);
+        std::vector<std::string> lines;
+        std::string_view line;
+        while (reader.next(line)) {
+            lines.emplace_back(line);
+        }
+        return lines;
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(read_pipe)
+    {
+        int fds[2];
+        BOOST_REQUIRE(pipe(fds) == 0);
+        std::string input("cmd1\n\n{\na_longer_command\n}\ncmd5");
+        BOOST_REQUIRE(write(fds[1], input.data(), input.size()) == ssize_t(input.size()));
+        close(fds[1]);
+        auto lines = read_lines(fds[0], 4);
+        close(fds[0]);
+        BOOST_CHECK(lines == std::vector<std::string>({"cmd1", "", "{", "a_longer_command", "}", "cmd5"}));
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(read_file)
+    {
+        std::string name("bulk_test_reader.txt");
+        {
+            std::ofstream file(name);
+            file << "cmd1\ncmd2\n\ncmd3\n";
+        }
+        int fd = open(name.c_str(), O_RDONLY);
+        BOOST_REQUIRE(fd >= 0);
+        auto lines = read_lines(fd, 4);
+        close(fd);
+        std::remove(name.c_str());
+        BOOST_CHECK(lines == std::vector<std::string>({"cmd1", "cmd2", "", "cmd3"}));
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(read_batches)
+    {
+        int fds[2];
+        BOOST_REQUIRE(pipe(fds) == 0);
+        std::string input("cmd1\ncmd2\ncmd3\n\ncmd5");
+        BOOST_REQUIRE(write(fds[1], input.data(), input.size()) == ssize_t(input.size()));
+        close(fds[1]);
+        LineReader reader(fds[0], 64);
+        std::vector<std::string_view> batch;
+        std::vector<LineKind> kinds;
+        std::vector<std::vector<std::string>> batches;
+        while (reader.next(batch, kinds, 3)) 
+            batches.emplace_back(batch.begin(), batch.end());
+        close(fds[0]);
+        // the last line waits for the end of the stream
+        BOOST_REQUIRE_EQUAL(batches.size(),3);
+        BOOST_CHECK(batches[0] == std::vector<std::string>({"cmd1", "cmd2", "cmd3"}));
+        BOOST_CHECK(batches[1] == std::vector<std::string>({""}));
+        BOOST_CHECK(batches[2] == std::vector<std::string>({"cmd5"}));
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(classify)
+    {
+        // lines of every length up to 40 put the delimiters at every offset of a 16 byte block
+        std::string input;
+        for (std::size_t i = 0; i < 600; i++) {
+            auto kind = i % 7;
+            input += kind == 0 ? "{" : kind == 3 ? "}" : kind == 5 ? "" : std::string(i % 41, 'a' + i % 26);
+            input += i % 13 == 0 ? "}\n" : "\n";
+        }
+        input += "{";
+
+        std::vector<std::string_view> lines, scalar_lines;
+        std::vector<LineKind> kinds, scalar_kinds;
+        auto taken = classify_lines(input.data(), input.size(), lines, kinds);
+        auto scalar_taken = classify_lines_scalar(input.data(), input.size(), scalar_lines, scalar_kinds);
+        BOOST_CHECK_EQUAL(taken,input.size() - 1);
+        BOOST_CHECK_EQUAL(scalar_taken,input.size() - 1);
+        BOOST_REQUIRE_EQUAL(lines.size(),600);
+        BOOST_CHECK(lines == scalar_lines);
+        BOOST_CHECK(kinds == scalar_kinds);
+        for (std::size_t i = 0; i < lines.size(); i++) 
+            BOOST_CHECK(kinds[i] == classify_line(lines[i]));
+        BOOST_CHECK(kinds[0] == LineKind::Text);
+        BOOST_CHECK(kinds[7] == LineKind::Open);
+        BOOST_CHECK(kinds[3] == LineKind::Close);
+
+        lines.clear();
+        kinds.clear();
+        taken = classify_lines(input.data(), input.size(), lines, kinds, 10);
+        BOOST_REQUIRE_EQUAL(lines.size(),10);
+        BOOST_CHECK_EQUAL(taken,std::size_t(lines.back().data() + lines.back().size() + 1 - input.data()));
+        BOOST_CHECK(lines[9] == scalar_lines[9]);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE(test_dispatcher)
+
+    BOOST_AUTO_TEST_CASE(merge_streams)
+    {
+        std::stringbuf out_buffer;
+        std::ostream out_stream(&out_buffer);
+        Dispatcher dispatcher({std::make_shared<ConsoleWriter>(out_stream)});
+
+        auto first = dispatcher.connect(3);
+        auto second = dispatcher.connect(3);
+        dispatcher.receive(first, "a\nb\n", 4);
+        dispatcher.receive(second, "c\n{\nd\n", 6);
+        dispatcher.receive(first, "e\nf", 3);
+        dispatcher.receive(second, "}\n", 2);
+        BOOST_CHECK_EQUAL(out_buffer.str(),"bulk: a, b, c\nbulk: d\n");
+
+        dispatcher.disconnect(first);
+        BOOST_CHECK_EQUAL(out_buffer.str(),"bulk: a, b, c\nbulk: d\n");
+        dispatcher.disconnect(second);
+        BOOST_CHECK_EQUAL(out_buffer.str(),"bulk: a, b, c\nbulk: d\nbulk: e, f\n");
+        BOOST_CHECK_THROW(dispatcher.receive(first, "g\n", 2),std::exception);
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(separate_sizes)
+    {
+        std::stringbuf out_buffer;
+        std::ostream out_stream(&out_buffer);
+        Dispatcher dispatcher({std::make_shared<ConsoleWriter>(out_stream)});
+
+        auto first = dispatcher.connect(1);
+        auto second = dispatcher.connect(2);
+        dispatcher.receive(second, "a\n{\nb", 5);
+        dispatcher.receive(first, "c\n", 2);
+        dispatcher.disconnect(second);
+        dispatcher.disconnect(first);
+        BOOST_CHECK_EQUAL(out_buffer.str(),"bulk: c\nbulk: a\n");
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(drop_bad_partial)
+    {
+        std::stringbuf out_buffer;
+        std::ostream out_stream(&out_buffer);
+        Dispatcher dispatcher({std::make_shared<ConsoleWriter>(out_stream)});
+
+        auto handle = dispatcher.connect(2);
+        std::string large(1025, 'x');
+        dispatcher.receive(handle, large.data(), large.size());
+        BOOST_CHECK_THROW(dispatcher.receive(handle, "\n", 1),std::exception);
+        dispatcher.receive(handle, "a\nb\n", 4);
+        BOOST_CHECK_EQUAL(out_buffer.str(),"bulk: a, b\n");
+        dispatcher.disconnect(handle);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE(test_server)
+
+    BOOST_AUTO_TEST_CASE(tcp_connections)
+    {
+        auto recordWriter = std::make_shared<RecordWriter>();
+        BulkServer server({recordWriter}, 2);
+        auto port = server.listen(0);
+        std::thread thread([&server] { server.run(); });
+
+        boost::asio::io_context io;
+        boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), port);
+        boost::asio::ip::tcp::socket first(io), second(io);
+        first.connect(endpoint);
+        second.connect(endpoint);
+        boost::asio::write(first, boost::asio::buffer(std::string("cmd1\n{\ncmd2\n")));
+        boost::asio::write(second, boost::asio::buffer(std::string("cmd3\n{\ncmd4\n}\n")));
+        boost::asio::write(first, boost::asio::buffer(std::string("cmd5\n}\n")));
+        first.close();
+        second.close();
+        for (auto i = 0; i < 500 && (server.getAccepted() < 2 || server.getActive() > 0); i++) 
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        server.stop();
+        thread.join();
+
+        std::multiset<std::string> bulks;
+        for (auto& bulk : recordWriter->bulks) 
+            bulks.insert(bulk->text);
+        BOOST_CHECK_EQUAL(server.getAccepted(), 2);
+        BOOST_CHECK_EQUAL(bulks.size(), 3);
+        // static commands of both connections share one bulk in arrival order
+        BOOST_CHECK_EQUAL(bulks.count("bulk: cmd1, cmd3\n") + bulks.count("bulk: cmd3, cmd1\n"), 1);
+        BOOST_CHECK_EQUAL(bulks.count("bulk: cmd2, cmd5\n"), 1);
+        BOOST_CHECK_EQUAL(bulks.count("bulk: cmd4\n"), 1);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE(test_queue)
+
+    BOOST_AUTO_TEST_CASE(ring_order)
+    {
+        RingQueue<int> queue(4, false);
+        int item = 0;
+        BOOST_CHECK(!queue.try_pop(item));
+        for (int i = 0; i < 4; i++) {
+            BOOST_CHECK(queue.try_push(i));
+        }
+        BOOST_CHECK(!queue.try_push(item));
+        BOOST_CHECK_EQUAL(queue.size(),4);
+        for (int i = 0; i < 4; i++) {
+            BOOST_CHECK(queue.try_pop(item));
+            BOOST_CHECK_EQUAL(item,i);
+        }
+        queue.close();
+        BOOST_CHECK(!queue.pop(item));
+        BOOST_CHECK(!queue.push(1));
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(drop_oldest)
+    {
+        RingQueue<int> queue(2, false, Backpressure::DropOldest);
+        for (int i = 0; i < 5; i++) {
+            BOOST_CHECK(queue.push(i));
+        }
+        BOOST_CHECK_EQUAL(queue.dropped(),3);
+        int item = 0;
+        BOOST_CHECK(queue.pop(item));
+        BOOST_CHECK_EQUAL(item,3);
+        BOOST_CHECK(queue.pop(item));
+        BOOST_CHECK_EQUAL(item,4);
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(spill)
+    {
+        RingQueue<int> queue(2, false, Backpressure::Spill);
+        for (int i = 0; i < 5; i++) {
+            BOOST_CHECK(queue.push(i));
+        }
+        BOOST_CHECK_EQUAL(queue.size(),5);
+        queue.close();
+        std::vector<int> items;
+        int item = 0;
+        while (queue.pop(item)) {
+            items.push_back(item);
+        }
+        BOOST_CHECK(items == std::vector<int>({0, 1, 2, 3, 4}));
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(spill_order)
+    {
+        // a slot frees up while 3 waits in the overflow list, 4 must still come after it
+        RingQueue<int> queue(2, false, Backpressure::Spill);
+        std::vector<int> items;
+        int item = 0;
+        for (int i = 1; i <= 3; i++) 
+            queue.push(i);
+        BOOST_REQUIRE(queue.pop(item));
+        items.push_back(item);
+        queue.push(4);
+        BOOST_REQUIRE(queue.pop(item));
+        items.push_back(item);
+        queue.push(5);
+        queue.close();
+        while (queue.pop(item)) 
+            items.push_back(item);
+        BOOST_CHECK(items == std::vector<int>({1, 2, 3, 4, 5}));
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(many_threads)
+    {
+        RingQueue<int> queue(8);
+        const int producers = 4, items = 10000;
+        std::atomic<long> sum{0};
+        std::vector<std::thread> threads;
+        for (int c = 0; c < 2; c++) {
+            threads.emplace_back([&] {
+                int item = 0;
+                while (queue.pop(item)) {
+                    sum += item;
+                }
+            });
+        }
+        std::vector<std::thread> writers;
+        for (int p = 0; p < producers; p++) {
+            writers.emplace_back([&] {
+                for (int i = 1; i <= items; i++) {
+                    queue.push(i);
+                }
+            });
+        }
+        for (auto& thread : writers) {
+            thread.join();
+        }
+        queue.close();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        BOOST_CHECK_EQUAL(sum.load(),long(producers) * items * (items + 1) / 2);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE(test_metrics)
+
+    BOOST_AUTO_TEST_CASE(count_commands)
+    {
+        std::stringbuf out_buffer, report_buffer;
+        std::ostream out_stream(&out_buffer), report_stream(&report_buffer);
+        auto& metrics = Metrics::local();
+        auto lines = metrics.lines.get(), commands = metrics.commands.get(); 
+        auto bulks = metrics.bulks.get(), bytes = metrics.bytes.get();
+
+        auto handler = std::make_shared<Handler>(2);
+        auto consoleWriter = std::make_shared<ConsoleWriter>(out_stream);
+        consoleWriter->subscribe(handler);
+        handler->setReport(report_stream);
+        for (auto line : {"cmd1", "cmd2", "{", "cmd3", "}"}) {
+            handler->addCommand(line);
+        }
+        handler->stop();
+
+        BOOST_CHECK_EQUAL(metrics.lines.get() - lines,5);
+        BOOST_CHECK_EQUAL(metrics.commands.get() - commands,3);
+        BOOST_CHECK_EQUAL(metrics.bulks.get() - bulks,2);
+        BOOST_CHECK_EQUAL(metrics.bytes.get() - bytes,out_buffer.str().size());
+        BOOST_CHECK(report_buffer.str().find(metrics.name + ": ") != std::string::npos);
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(latency_histogram)
+    {
+        ThreadMetrics::Histogram histogram;
+        for (int i = 0; i < 98; i++) {
+            histogram.add(std::chrono::microseconds(3));
+        }
+        histogram.add(std::chrono::microseconds(100));
+        histogram.add(std::chrono::microseconds(100));
+        BOOST_CHECK_EQUAL(histogram.count.get(),100);
+        BOOST_CHECK_EQUAL(histogram.sum.get(),494);
+        BOOST_CHECK_EQUAL(histogram.percentile(0.5),4);
+        BOOST_CHECK_EQUAL(histogram.percentile(0.99),128);
+
+        ThreadMetrics::Histogram bound;
+        bound.add(std::chrono::microseconds(4));
+        BOOST_CHECK_EQUAL(bound.percentile(1),4);
+        bound.add(std::chrono::microseconds(1));
+        BOOST_CHECK_EQUAL(bound.percentile(0.5),1);
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(export_text)
+    {
+        auto writer = std::make_shared<AsyncWriter>(std::vector<std::shared_ptr<Observer>>{std::make_shared<RecordWriter>()});
+        Metrics::setThreadName("exporter_test");
+        Metrics::local().lines.add();
+        std::stringbuf out_buffer;
+        std::ostream out_stream(&out_buffer);
+        Metrics::instance().exportText(out_stream);
+        auto text = out_buffer.str();
+        BOOST_CHECK(text.find("# TYPE bulk_lines_total counter\n") != std::string::npos);
+        BOOST_CHECK(text.find("bulk_lines_total{thread=\"exporter_test\"} ") != std::string::npos);
+        BOOST_CHECK(text.find("bulk_write_latency_us_bucket{thread=\"exporter_test\",le=\"+Inf\"} ") != std::string::npos);
+        BOOST_CHECK(text.find("bulk_queue_depth{queue=\"async") != std::string::npos);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE(test_tracer)
+
+    BOOST_AUTO_TEST_CASE(trace_bulks)
+    {
+        std::stringbuf out_buffer, trace_buffer;
+        std::ostream out_stream(&out_buffer), trace_stream(&trace_buffer);
+        auto handler = std::make_shared<Handler>(2);
+        auto consoleWriter = std::make_shared<AsyncWriter>(
+            std::vector<std::shared_ptr<Observer>>{std::make_shared<ConsoleWriter>(out_stream)});
+        consoleWriter->subscribe(handler);
+
+        handler->addCommand("cmd1");
+        Tracer::instance().start();
+        handler->addCommand("cmd2");
+        handler->addCommand("cmd3");
+        handler->addCommand("cmd4");
+        handler->stop();
+        Tracer::instance().stop();
+        Tracer::instance().write(trace_stream);
+        auto trace = trace_buffer.str();
+
+        auto count = [&](const std::string& text) {
+            std::size_t found = 0;
+            for (auto pos = trace.find(text); pos != std::string::npos; pos = trace.find(text, pos + 1)) {
+                found++;
+            }
+            return found;
+        };
+#ifdef BULK_TRACING
+        BOOST_CHECK_EQUAL(trace.compare(0, 16, "{\"traceEvents\":["),0);
+        BOOST_CHECK_EQUAL(count("\"name\":\"collect\""),2);
+        BOOST_CHECK_EQUAL(count("\"name\":\"print\""),2);
+        BOOST_CHECK_EQUAL(count("\"name\":\"queued\""),2);
+        BOOST_CHECK_EQUAL(count("\"name\":\"write\""),2);
+        BOOST_CHECK_EQUAL(count("\"args\":{\"bulk\":1,\"commands\":2}"),4);
+#else
+        BOOST_CHECK_EQUAL(count("\"ph\":\"X\""),0);
+#endif
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if defined(__cpp_impl_coroutine)
+// fire and forget coroutine, enough to drive Ingestor::submitAsync()
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+Detached ingest(Ingestor& ingestor, std::vector<std::string> lines, std::promise<Ingestor::Result>& done) {
+    try {
+        done.set_value(co_await ingestor.submitAsync(std::move(lines)));
+    } catch(...) {
+        done.set_exception(std::current_exception());
+    }
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE(test_ingestor)
+
+    BOOST_AUTO_TEST_CASE(submit_future)
+    {
+        auto recordWriter = std::make_shared<RecordWriter>();
+        Ingestor ingestor({recordWriter}, 2);
+
+        auto first = ingestor.submit({"cmd1", "cmd2", "cmd3"});
+        auto result = first.get();
+        BOOST_CHECK_EQUAL(result.lines,3);
+        BOOST_CHECK_EQUAL(result.bulks,1);
+        BOOST_CHECK_EQUAL(recordWriter->bulks.size(),1);
+        BOOST_CHECK_EQUAL(recordWriter->bulks[0]->body(),"bulk: cmd1, cmd2");
+
+        auto second = ingestor.submit({"{", "}"});
+        BOOST_CHECK_THROW(second.get(), std::runtime_error);
+
+        ingestor.submit({"cmd4"});
+        ingestor.close().get();
+        BOOST_CHECK_EQUAL(recordWriter->bulks.size(),3);
+        BOOST_CHECK_EQUAL(recordWriter->bulks[1]->body(),"bulk: cmd3");
+        BOOST_CHECK_EQUAL(recordWriter->bulks[2]->body(),"bulk: cmd4");
+        BOOST_CHECK_THROW(ingestor.submit({"cmd6"}), std::runtime_error);
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+    BOOST_AUTO_TEST_CASE(submit_callbacks)
+    {
+        std::stringbuf out_buffer;
+        std::ostream out_stream(&out_buffer);
+        auto consoleWriter = std::make_shared<AsyncWriter>(
+            std::vector<std::shared_ptr<Observer>>{std::make_shared<ConsoleWriter>(out_stream)});
+        std::promise<std::string> output;
+        {
+            Ingestor ingestor({consoleWriter}, 1);
+            ingestor.submit({"cmd1"}, [](const Ingestor::Result&, std::exception_ptr) {});
+            ingestor.submit({"cmd2"}, [&](const Ingestor::Result& result, std::exception_ptr error) {
+                BOOST_CHECK(!error);
+                BOOST_CHECK_EQUAL(result.bulks,1);
+                output.set_value(out_buffer.str());
+            });
+        }
+        BOOST_CHECK_EQUAL(output.get_future().get(),"bulk: cmd1\nbulk: cmd2\n");
+    }
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if defined(__cpp_impl_coroutine)
+    BOOST_AUTO_TEST_CASE(submit_coroutine)
+    {
+        auto recordWriter = std::make_shared<RecordWriter>();
+        Ingestor ingestor({recordWriter}, 3);
+
+        std::promise<Ingestor::Result> done;
+        ingest(ingestor, {"cmd1", "cmd2", "cmd3", "cmd4"}, done);
+        auto result = done.get_future().get();
+        BOOST_CHECK_EQUAL(result.lines,4);
+        BOOST_CHECK_EQUAL(result.bulks,1);
+        BOOST_CHECK_EQUAL(recordWriter->bulks[0]->body(),"bulk: cmd1, cmd2, cmd3");
+
+        std::promise<Ingestor::Result> failed;
+        ingest(ingestor, {"{", "}"}, failed);
+        BOOST_CHECK_THROW(failed.get_future().get(), std::runtime_error);
+        ingestor.close().get();
+    }
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,24 +1,97 @@
 #include <iostream>
+#include <algorithm>
 
 #include "Writers.h"
+#include "AsyncWriter.h"
+#include "FileWriterPool.h"
+#include "Metrics.h"
+#include "Tracer.h"
 #include "Parser.h"
+#include "Reader.h"
+
+#include <unistd.h>
 
 int main(int argc, char *argv[]) 
 {
   try {
-    auto handler = std::make_shared<Handler>(start_parsing(argc,argv));
-    auto consoleWriter = std::make_shared<ConsoleWriter>();
-    auto fileWriter = std::make_shared<FileWriter>();
-    consoleWriter->subscribe(handler);
-    fileWriter->subscribe(handler);  
-    std::string line;
-    while (std::getline(std::cin, line)) {
-      handler->addCommand(line);
+    auto options = parse_options(argc, argv);
+    Metrics::setThreadName("main");
+    std::unique_ptr<MetricsExporter> exporter;
+    if (!options.metrics_file.empty()) {
+      exporter = std::make_unique<MetricsExporter>(options.metrics_file, std::chrono::milliseconds(options.metrics_interval));
+    }
+    if (!options.trace_file.empty()) {
+      Tracer::instance().start();
+    }
+    auto handler = std::make_shared<Handler>(options.N);
+    auto backend = options.io_uring ? FileWriter::Backend::Uring : FileWriter::Backend::Blocking;
+    std::vector<std::shared_ptr<Observer>> writers;
+    std::shared_ptr<Observer> consoleWriter = std::make_shared<ConsoleWriter>(std::cout, options.flush);
+    std::shared_ptr<Observer> fileWriter;
+    std::shared_ptr<FileWriterPool> pool;
+    if (options.segment_size > 0) {
+      // segments are appended in order, so there is a single writer even with --file-threads
+      fileWriter = std::make_shared<SegmentWriter>(options.segment_size, options.segment_age, options.flush, 
+        options.durability);
+      if (options.file_threads > 0) {
+        fileWriter = std::make_shared<AsyncWriter>(
+          std::vector<std::shared_ptr<Observer>>{fileWriter}, options.queue_size, options.backpressure);
+      }
+    } else if (options.file_threads > 0) {
+      pool = std::make_shared<FileWriterPool>(options.file_threads, options.flush, options.queue_size, 
+        options.backpressure, backend, options.durability, options.compression);
+      fileWriter = pool;
+    } else {
+      fileWriter = std::make_shared<FileWriter>(options.flush, backend, options.durability, 
+        options.compression);
+      // compression stays off the Handler thread even without --file-threads
+      if (options.compression != Compressor::None) {
+        fileWriter = std::make_shared<AsyncWriter>(
+          std::vector<std::shared_ptr<Observer>>{fileWriter}, options.queue_size, options.backpressure);
+      }
+    }
+    if (options.file_threads > 0) {
+      consoleWriter = std::make_shared<AsyncWriter>(
+        std::vector<std::shared_ptr<Observer>>{consoleWriter}, options.queue_size, options.backpressure);
+    }
+    writers.push_back(consoleWriter);
+    writers.push_back(fileWriter);
+    for (auto& writer : writers) {
+      writer->subscribe(handler);
+    }
+    if (options.stats) {
+      handler->setReport(std::cerr);
+    }
+    if (options.max_bulk > 0) {
+      handler->setAdaptive(options.min_bulk, options.max_bulk);
+    }
+    if (options.block_memory > 0) {
+      handler->setBlockMemory(options.block_memory);
+    }
+    if (options.max_delay_ms > 0) {
+      handler->setMaxDelay(std::chrono::milliseconds(options.max_delay_ms));
+    }
+    LineReader reader(STDIN_FILENO);
+    std::vector<std::string_view> lines;
+    std::vector<LineKind> kinds;
+    while (reader.next(lines, kinds)) {
+      handler->addCommands(lines, kinds);
     }
     handler->stop();
+    if (options.stats && pool) {
+      auto stats = pool->stats();
+      for (std::size_t i = 0; i < stats.size(); i++) {
+        std::cerr << "file" << i << ": " << stats[i].bulks << " bulks, " << stats[i].commands << " commands, " 
+          << stats[i].bytes << " bytes, " << stats[i].stolen << " stolen" << std::endl;
+      }
+    }
+    if (!options.trace_file.empty()) {
+      Tracer::instance().stop();
+      Tracer::instance().writeFile(options.trace_file);
+    }
   } catch(const std::exception &e) {
     std::cerr << e.what() << std::endl;
   }
 
   return 0;
-}
\ No newline at end of file
+}